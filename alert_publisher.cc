@@ -0,0 +1,131 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "alert_publisher.h"
+#include "config_store.h"
+#include "departure.h"
+#include "stage_stats.h"
+
+using namespace cv;
+using namespace std;
+
+// Departures are rare, a short ring only has to cover a burst
+static const int ALERT_RING_SIZE = 64;
+
+void AlertPublisher::Deliver(const DepartureEvent& ev)
+{
+	double latency = (getTickCount() - ev.capture_tick) / getTickFrequency();
+
+	char msg[128];
+	int len = snprintf(msg, sizeof(msg), "departure frame=%ld side=%s offset=%.1f latency_ms=%.2f\n",
+			ev.frame, ev.right ? "right" : "left", ev.offset, latency * 1e3);
+
+	if (sock >= 0) {
+		// A missing or slow listener loses the alert rather than
+		// holding up the ones behind it
+		if (sendto(sock, msg, len, MSG_DONTWAIT, (struct sockaddr*)&addr, sizeof(addr)) != len) {
+			dropped.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+	} else {
+		fputs(msg, stdout);
+		fflush(stdout);
+	}
+
+	// Delivered, so this is the full capture to alert latency
+	StageStats::GetInstance()->Record(STAGE_ALERT, (getTickCount() - ev.capture_tick) / getTickFrequency());
+	delivered.fetch_add(1, memory_order_relaxed);
+}
+
+void AlertPublisher::Loop()
+{
+	// Sleeps until an event comes in or Stop() is called
+	DepartureEvent ev;
+	while (ring.Pop(ev, stop))
+		Deliver(ev);
+
+	// Events published before Stop() may still be in the ring when the
+	// wait gives up, send them before leaving
+	while (ring.TryPop(ev))
+		Deliver(ev);
+}
+
+bool AlertPublisher::Publish(const DepartureEvent& ev)
+{
+	if (ring.TryPush(ev))
+		return true;
+	dropped.fetch_add(1, memory_order_relaxed);
+	return false;
+}
+
+void AlertPublisher::Start()
+{
+	if (!cs->alert_socket.empty()) {
+		if (cs->alert_socket.size() >= sizeof(addr.sun_path)) {
+			cerr << "error: alert socket path too long: " << cs->alert_socket << endl;
+		} else {
+			sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+			if (sock < 0)
+				cerr << "error: cannot create alert socket" << endl;
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strcpy(addr.sun_path, cs->alert_socket.c_str());
+		}
+	}
+
+	stop.store(false);
+	worker = thread(&AlertPublisher::Loop, this);
+}
+
+void AlertPublisher::Stop()
+{
+	if (!worker.joinable())
+		return;
+
+	stop.store(true);
+	ring.Interrupt();
+	worker.join();
+
+	if (sock >= 0) {
+		close(sock);
+		sock = -1;
+	}
+}
+
+AlertPublisher::AlertPublisher(const ConfigStore *cs)
+	: ring(ALERT_RING_SIZE)
+{
+	this->cs = cs;
+	sock = -1;
+	stop.store(false);
+	delivered.store(0);
+	dropped.store(0);
+}
+
+AlertPublisher::~AlertPublisher()
+{
+	Stop();
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef ALERT_PUBLISHER_H
+#define ALERT_PUBLISHER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+
+#include "config_store.h"
+#include "departure.h"
+#include "spsc_queue.h"
+
+// Delivers departure events from the frame loop on a thread of its own,
+// so an alert never waits for rendering or encoding. Events go out as
+// one line each, to stdout or as datagrams to the Unix socket named by
+// alert_socket. The capture to delivery time of every event is recorded
+// as the alert stage.
+class AlertPublisher
+{
+	public:
+		AlertPublisher(const ConfigStore *cs);
+		~AlertPublisher();
+		void Start();
+		void Stop();
+
+		// Never blocks, the event is dropped when the ring is full
+		bool Publish(const DepartureEvent& ev);
+
+		uint64_t Delivered() const { return delivered.load(std::memory_order_relaxed); }
+		uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+	private:
+		void Loop();
+		void Deliver(const DepartureEvent& ev);
+
+		const ConfigStore *cs;
+		SpscQueue<DepartureEvent> ring;
+		int sock;
+		struct sockaddr_un addr;
+		std::thread worker;
+		std::atomic<bool> stop;
+		std::atomic<uint64_t> delivered, dropped;
+};
+
+#endif // ALERT_PUBLISHER_H
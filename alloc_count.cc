@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include "alloc_count.h"
+
+#ifdef LDWS_ALLOC_DEBUG
+
+#include <errno.h>
+#include <stddef.h>
+
+// glibc entry points behind the public allocator functions
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+// libldws is built as PIC, where TLS defaults to the dynamic models
+// whose __tls_get_addr may allocate on first use and recurse into
+// malloc. Initial-exec is a fixed offset from the thread pointer.
+static __thread uint64_t thread_allocs __attribute__((tls_model("initial-exec")));
+
+uint64_t ThreadAllocCount()
+{
+	return thread_allocs;
+}
+
+// operator new and cv::fastMalloc end up here as well
+extern "C" void *malloc(size_t size)
+{
+	thread_allocs++;
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	thread_allocs++;
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	thread_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+	thread_allocs++;
+	return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+	thread_allocs++;
+	return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+
+	thread_allocs++;
+	void *p = __libc_memalign(alignment, size);
+	if (!p)
+		return ENOMEM;
+	*ptr = p;
+	return 0;
+}
+
+#endif // LDWS_ALLOC_DEBUG
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stdint.h>
+
+// Number of heap allocations made so far by the calling thread. Builds
+// with -DLDWS_ALLOC_DEBUG=ON interpose malloc and friends for the whole
+// process, OpenCV included; other builds always return 0.
+#ifdef LDWS_ALLOC_DEBUG
+uint64_t ThreadAllocCount();
+#else
+static inline uint64_t ThreadAllocCount() { return 0; }
+#endif
+
+#endif // ALLOC_COUNT_H
@@ -0,0 +1,263 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdio.h>
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.h"
+#include "config_store.h"
+#include "frame.h"
+#include "frame_source.h"
+#include "lane_detector.h"
+#include "lane_snapshot.h"
+#include "line_detector.h"
+
+using namespace cv;
+using namespace std;
+
+static string clip_basename(const string& path)
+{
+	size_t slash = path.find_last_of('/');
+	string name = (slash == string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == string::npos) ? name : name.substr(0, dot);
+}
+
+// Compares the lanes of two result files frame by frame. Returns the
+// number of lanes tracked in both, or -1 if a file cannot be read.
+static long compare_lanes(const string& name, const string& ref_name, double& k_error, double& b_error)
+{
+	ifstream in(name.c_str());
+	ifstream ref(ref_name.c_str());
+	if (!in || !ref)
+		return -1;
+
+	// Skip the headers
+	string line, ref_line;
+	getline(in, line);
+	getline(ref, ref_line);
+
+	long compared = 0;
+	while (getline(in, line) && getline(ref, ref_line)) {
+		long frame, ref_frame;
+		float v[4], r[4];
+		int lost[2], ref_lost[2];
+		if (sscanf(line.c_str(), "%ld,%f,%f,%d,%f,%f,%d", &frame, &v[0], &v[1], &lost[0], &v[2], &v[3], &lost[1]) != 7 ||
+				sscanf(ref_line.c_str(), "%ld,%f,%f,%d,%f,%f,%d", &ref_frame, &r[0], &r[1], &ref_lost[0], &r[2], &r[3], &ref_lost[1]) != 7 ||
+				frame != ref_frame)
+			break;
+
+		for (int s = 0; s < 2; s++) {
+			float k = v[2 * s], b = v[2 * s + 1];
+			float ref_k = r[2 * s], ref_b = r[2 * s + 1];
+			if (lost[s] || ref_lost[s] || !std::isfinite(k + b + ref_k + ref_b))
+				continue;
+			k_error += fabs(k - ref_k);
+			b_error += fabs(b - ref_b);
+			compared++;
+		}
+	}
+
+	return compared;
+}
+
+BatchRunner::ClipResult BatchRunner::ProcessClip(const string& clip)
+{
+	ClipResult result;
+
+	// Private configuration, nothing below touches the shared instance
+	ConfigStore cfg(*cs);
+	cfg.video_in = clip;
+	cfg.display_enabled = false;
+	cfg.intermediate_display = false;
+	cfg.file_write = false;
+	cfg.headless = true;
+	cfg.verbose = false;
+
+	FrameSource *source = FrameSource::Open(&cfg);
+	if (!source->IsOpened()) {
+		cerr << "error: cannot open " << clip << endl;
+		delete source;
+		return result;
+	}
+
+	string out_name = cfg.batch_output_dir + "/" + clip_basename(clip) + ".csv";
+	ofstream out(out_name.c_str());
+	if (!out) {
+		cerr << "error: cannot write " << out_name << endl;
+		delete source;
+		return result;
+	}
+	out << "frame,left_k,left_b,left_lost,right_k,right_b,right_lost" << endl;
+
+	LaneSnapshot lanes;
+	LineDetector line_detector(&cfg, &lanes);
+	LaneDetector lane_detector(&cfg);
+	Frame f;
+
+	double begin = getTickCount();
+	while (true) {
+		if (!source->Read(&f))
+			break;
+
+		line_detector.Detect(&f);
+		if (f.verify_only)
+			lane_detector.TrackLanes(f.edge, f.Scan());
+		else
+			lane_detector.ProcessLanes(f.lines, f.edge, f.Width(), f.left_lines, f.Scan());
+
+		LaneDetector::LaneState l = lane_detector.GetLaneState(false);
+		LaneDetector::LaneState r = lane_detector.GetLaneState(true);
+		lanes.Publish(f.index, l, r);
+		out << f.index << "," << l.k << "," << l.b << "," << l.lost << ","
+			<< r.k << "," << r.b << "," << r.lost << '\n';
+		f.index++;
+	}
+	result.seconds = ((double)getTickCount() - begin) / getTickFrequency();
+	result.frames = f.index;
+	result.ok = true;
+	delete source;
+
+	if (!cfg.batch_reference_dir.empty()) {
+		out.close();
+		string ref_name = cfg.batch_reference_dir + "/" + clip_basename(clip) + ".csv";
+		result.compared = compare_lanes(out_name, ref_name, result.k_error, result.b_error);
+		if (result.compared < 0)
+			cerr << "error: cannot compare " << out_name << " with " << ref_name << endl;
+	}
+
+	return result;
+}
+
+void BatchRunner::WorkerLoop()
+{
+	while (true) {
+		size_t i = next_clip.fetch_add(1);
+		if (i >= inputs.size())
+			break;
+		results[i] = ProcessClip(inputs[i]);
+	}
+}
+
+int BatchRunner::Run()
+{
+	FrameSource::ExpandInputs(cs->batch_input, inputs);
+	if (inputs.empty()) {
+		cerr << "error: no batch inputs in " << cs->batch_input << endl;
+		return 1;
+	}
+
+	// Results and references are named after the clip alone, so clips
+	// of the same name in different directories would share them
+	map<string, string> names;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		string name = clip_basename(inputs[i]);
+		if (names.count(name)) {
+			cerr << "error: " << names[name] << " and " << inputs[i]
+				<< " would both write " << name << ".csv" << endl;
+			return 1;
+		}
+		names[name] = inputs[i];
+	}
+
+	int jobs = cs->jobs;
+	if (jobs <= 0)
+		jobs = thread::hardware_concurrency();
+	if (jobs <= 0)
+		jobs = 1;
+	if (jobs > (int)inputs.size())
+		jobs = inputs.size();
+
+	// Parallelism comes from running clips side by side; keep OpenCV
+	// from spawning its own threads inside every worker
+	setNumThreads(1);
+
+	cout << "Batch: " << inputs.size() << " clips, " << jobs << " jobs" << endl;
+
+	results.assign(inputs.size(), ClipResult());
+	next_clip.store(0);
+
+	double begin = getTickCount();
+	vector<thread> workers;
+	for (int i = 0; i < jobs; i++)
+		workers.push_back(thread(&BatchRunner::WorkerLoop, this));
+	for (int i = 0; i < jobs; i++)
+		workers[i].join();
+	double wall = ((double)getTickCount() - begin) / getTickFrequency();
+
+	long total_frames = 0;
+	int failed = 0;
+	long compared = 0;
+	double k_error = 0, b_error = 0;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		if (!results[i].ok) {
+			failed++;
+			continue;
+		}
+		total_frames += results[i].frames;
+		if (results[i].compared > 0) {
+			compared += results[i].compared;
+			k_error += results[i].k_error;
+			b_error += results[i].b_error;
+		}
+		if (cs->verbose)
+			cout << inputs[i] << ": " << results[i].frames << " frames, "
+				<< (results[i].frames / results[i].seconds) << " FPS" << endl;
+	}
+
+	cout << "Batch: " << total_frames << " frames in " << wall << " s, "
+		<< (total_frames / wall) << " FPS aggregate";
+	if (failed)
+		cout << ", " << failed << " clips failed";
+	cout << endl;
+
+	if (!cs->batch_reference_dir.empty() && compared > 0)
+		cout << "Batch: lanes differ from " << cs->batch_reference_dir << " by mean |dk| "
+			<< k_error / compared << ", |db| " << b_error / compared << " px over "
+			<< compared << " lanes" << endl;
+
+	// Regression limits, a run that tracks no lane at all fails too
+	if (cs->batch_max_error > 0 && !cs->batch_reference_dir.empty()) {
+		if (compared <= 0) {
+			cerr << "error: no lanes to compare with " << cs->batch_reference_dir << endl;
+			failed++;
+		} else if (b_error / compared > cs->batch_max_error) {
+			cerr << "error: mean lane error " << b_error / compared << " px is above "
+				<< cs->batch_max_error << endl;
+			failed++;
+		}
+	}
+	if (cs->batch_min_fps > 0 && total_frames / wall < cs->batch_min_fps) {
+		cerr << "error: " << total_frames / wall << " FPS is below " << cs->batch_min_fps << endl;
+		failed++;
+	}
+
+	return failed ? 1 : 0;
+}
+
+BatchRunner::BatchRunner(ConfigStore *cs)
+{
+	this->cs = cs;
+	next_clip.store(0);
+}
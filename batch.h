@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "config_store.h"
+
+using namespace std;
+
+// Runs detection over many clips on a pool of worker threads. Every clip
+// gets its own copy of the configuration and its own detectors, and the
+// tracked lanes of each frame are written to <batch-out>/<clip>.csv.
+class BatchRunner
+{
+	public:
+		BatchRunner(ConfigStore *cs);
+		int Run();
+
+	private:
+		struct ClipResult {
+			ClipResult():frames(0),seconds(0),ok(false),compared(0),k_error(0),b_error(0){}
+			long frames;
+			double seconds;
+			bool ok;
+			// Lanes compared with --batch-ref and their summed
+			// absolute parameter differences
+			long compared;
+			double k_error, b_error;
+		};
+
+		void WorkerLoop();
+		ClipResult ProcessClip(const string& clip);
+
+		ConfigStore *cs;
+		vector<string> inputs;
+		vector<ClipResult> results;
+		atomic<size_t> next_clip;
+};
+
+#endif // BATCH_H
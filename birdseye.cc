@@ -0,0 +1,223 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "birdseye.h"
+#include "config_store.h"
+#include "edge_runs.h"
+
+using namespace cv;
+using namespace std;
+
+// Top view size in cells
+static const int VIEW_W = 256;
+static const int VIEW_H = 128;
+// Sliding windows per side, from the bottom of the view to the top
+static const int NUM_WINDOWS = 8;
+// Columns each window reaches left and right of its center
+static const int WINDOW_MARGIN = 16;
+// Columns summed around each histogram column
+static const int PEAK_RADIUS = 2;
+// Edge pixels needed for a histogram peak, to recenter a window and
+// to fit a side
+static const int MIN_PEAK = 10;
+static const int MIN_RECENTER = 8;
+static const int MIN_FIT = 30;
+
+void BirdsEye::Calibrate(Size size)
+{
+	this->size = size;
+	row_map.resize(size.height);
+	cells.resize(VIEW_W * VIEW_H);
+	histogram.resize(VIEW_W);
+	if (size.width < 2 || size.height < 2)
+		return;
+
+	// Road width at row y grows as y - horizon, and the distance on the
+	// road as 1 / (y - horizon). The horizon is above the ROI, where
+	// lanes meet.
+	float r = min(max(cs->birdseye_top_ratio, 0.05f), 0.95f);
+	float w = size.width;
+	float h = size.height;
+	horizon = -r * h / (1 - r);
+	near_z = 1 / (h - horizon);
+	far_z = 1 / (0 - horizon);
+
+	float cx = w / 2;
+	for (int y = 0; y < size.height; y++) {
+		RowMap& m = row_map[y];
+		float z = 1 / (y - horizon);
+		m.v = min((int)((far_z - z) / (far_z - near_z) * VIEW_H), VIEW_H - 1);
+
+		// Pixel centers across the road width of this row map onto the
+		// view width
+		float scale = VIEW_W / (w * (y - horizon) / (h - horizon));
+		m.scale = lrintf(scale * 65536);
+		m.offset = lrintf(((0.5f - cx) * scale + VIEW_W / 2) * 65536);
+
+		// Pixels outside of the view are cut off here, once
+		m.x_begin = 0;
+		while (m.x_begin < size.width && (m.x_begin * m.scale + m.offset) >> 16 < 0)
+			m.x_begin++;
+		m.x_end = m.x_begin;
+		while (m.x_end < size.width && (m.x_end * m.scale + m.offset) >> 16 < VIEW_W)
+			m.x_end++;
+	}
+}
+
+Point2f BirdsEye::ToRoi(float u, float v) const
+{
+	float z = far_z - v / VIEW_H * (far_z - near_z);
+	float y = horizon + 1 / z;
+	float width = size.width * (y - horizon) / (size.height - horizon);
+	return Point2f(size.width / 2.f + (u - VIEW_W / 2) * width / VIEW_W - 0.5f, y);
+}
+
+void BirdsEye::Warp(const Mat& edge, const EdgeRuns *runs)
+{
+	fill(cells.begin(), cells.end(), 0);
+	fill(histogram.begin(), histogram.end(), 0);
+
+	// Every edge pixel is moved into its cell, so none are lost where
+	// the view shrinks the road. Only the near half of the view goes
+	// into the histogram, the lanes are straightest there.
+	for (int y = 0; y < size.height; y++) {
+		const RowMap& m = row_map[y];
+		uint16_t *row = &cells[m.v * VIEW_W];
+		bool near = m.v >= VIEW_H / 2;
+		if (runs) {
+			for (const EdgeRuns::Run *r = runs->RowBegin(y); r != runs->RowEnd(y); r++) {
+				int x_end = min(r->end, m.x_end);
+				for (int x = max(r->begin, m.x_begin); x < x_end; x++) {
+					int u = (x * m.scale + m.offset) >> 16;
+					row[u]++;
+					if (near)
+						histogram[u]++;
+				}
+			}
+		} else {
+			const uchar *p = edge.ptr<uchar>(y);
+			for (int x = m.x_begin; x < m.x_end; x++) {
+				if (!p[x])
+					continue;
+				int u = (x * m.scale + m.offset) >> 16;
+				row[u]++;
+				if (near)
+					histogram[u]++;
+			}
+		}
+	}
+}
+
+bool BirdsEye::FindSide(bool right, vector<Vec4i>& lines)
+{
+	// The strongest column of this half of the view
+	int begin = right ? VIEW_W / 2 : 0;
+	int end = right ? VIEW_W : VIEW_W / 2;
+	int center = -1, best = 0;
+	for (int u = begin; u < end; u++) {
+		int sum = 0;
+		for (int i = max(u - PEAK_RADIUS, 0); i <= min(u + PEAK_RADIUS, VIEW_W - 1); i++)
+			sum += histogram[i];
+		if (sum > best) {
+			best = sum;
+			center = u;
+		}
+	}
+	if (best < MIN_PEAK)
+		return false;
+
+	// Follow the lane up the view, fitting u = a*v + c by least squares
+	// over the cells in the windows
+	const int window_h = VIEW_H / NUM_WINDOWS;
+	double s = 0, sv = 0, su = 0, svv = 0, svu = 0;
+	int v_top = VIEW_H, v_bottom = 0, hits = 0;
+	for (int i = 0; i < NUM_WINDOWS; i++) {
+		int v1 = VIEW_H - i * window_h;
+		int v0 = v1 - window_h;
+		int u0 = max(center - WINDOW_MARGIN, 0);
+		int u1 = min(center + WINDOW_MARGIN + 1, VIEW_W);
+		long n = 0, nu = 0;
+		for (int v = v0; v < v1; v++) {
+			const uint16_t *row = &cells[v * VIEW_W];
+			double vc = v + 0.5;
+			for (int u = u0; u < u1; u++) {
+				int k = row[u];
+				if (!k)
+					continue;
+				double uc = u + 0.5;
+				n += k;
+				nu += k * u;
+				s += k;
+				sv += k * vc;
+				su += k * uc;
+				svv += k * vc * vc;
+				svu += k * uc * vc;
+			}
+		}
+		if (!n)
+			continue;
+		v_top = min(v_top, v0);
+		v_bottom = max(v_bottom, v1);
+		hits++;
+		if (n >= MIN_RECENTER)
+			center = nu / n;
+	}
+
+	double det = s * svv - sv * sv;
+	if (s < MIN_FIT || hits < 2 || det <= 0)
+		return false;
+	double a = (s * svu - sv * su) / det;
+	double c = (su - a * sv) / s;
+
+	// From the bottom to the top cell row the windows found pixels in
+	float vb = v_bottom - 0.5f;
+	float vt = v_top + 0.5f;
+	Point2f p0 = ToRoi(a * vb + c, vb);
+	Point2f p1 = ToRoi(a * vt + c, vt);
+	lines.push_back(Vec4i(lrintf(p0.x), lrintf(p0.y), lrintf(p1.x), lrintf(p1.y)));
+	return true;
+}
+
+int BirdsEye::Detect(const Mat& edge, vector<Vec4i>& lines, const EdgeRuns *runs)
+{
+	CV_Assert(edge.type() == CV_8UC1);
+	lines.clear();
+
+	if (edge.size() != size)
+		Calibrate(edge.size());
+	if (size.width < 2 || size.height < 2)
+		return 0;
+	if (runs)
+		CV_Assert(runs->EdgeSize() == size);
+
+	Warp(edge, runs);
+	int left_count = FindSide(false, lines);
+	FindSide(true, lines);
+	return left_count;
+}
+
+BirdsEye::BirdsEye(const ConfigStore *cs)
+{
+	this->cs = cs;
+	size = Size(0, 0);
+	horizon = near_z = far_z = 0;
+}
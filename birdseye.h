@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef BIRDSEYE_H
+#define BIRDSEYE_H
+
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "config_store.h"
+#include "edge_runs.h"
+
+using namespace cv;
+using namespace std;
+
+// Lane finding in a top-down view of the road. The ROI is taken as a
+// flat road seen in perspective, lanes meeting at the horizontal center
+// above it: its top row covers birdseye_top_ratio of the road width
+// that the bottom row covers. Warped to a top view, lanes are near
+// vertical, so a column histogram of the near half places them and
+// windows slid up the view follow them. Each side found gives one
+// candidate segment in ROI coordinates, like a Hough engine.
+class BirdsEye
+{
+	public:
+		BirdsEye(const ConfigStore *cs);
+
+		// Appends the left candidate to lines first, followed by the
+		// right one, and returns how many left candidates there are.
+		// Edge pixels come from runs when given, which must describe edge.
+		int Detect(const Mat& edge, vector<Vec4i>& lines, const EdgeRuns *runs = NULL);
+
+	private:
+		// Rows of the ROI stay rows in the top view, and along a row the
+		// warp is linear. So the remap table has one integer entry per
+		// ROI row: the top view row v and u = (x * scale + offset) >> 16.
+		// Pixels in [x_begin, x_end) land inside the view.
+		struct RowMap {
+			int v;
+			int scale, offset;
+			int x_begin, x_end;
+		};
+
+		void Calibrate(Size size);
+		void Warp(const Mat& edge, const EdgeRuns *runs);
+		bool FindSide(bool right, vector<Vec4i>& lines);
+		// Top view coordinates back to the ROI
+		Point2f ToRoi(float u, float v) const;
+
+		const ConfigStore *cs;
+		Size size;
+		vector<RowMap> row_map;
+		// Perspective of the calibration, for mapping back
+		float horizon, near_z, far_z;
+		vector<uint16_t> cells;     // edge pixels per top view cell
+		vector<int> histogram;      // per column, near half only
+};
+
+#endif // BIRDSEYE_H
@@ -22,13 +22,25 @@
 
 #include "config.h"
 #include "config_store.h"
+#include "cpu_kernels.h"
 
 using namespace std;
 using namespace libconfig;
 
+std::string ConfigStore::BuildVersion()
+{
+	std::string version = LDWS_VERSION;
+	version += " (kernels ";
+	version += GetCpuKernels().name;
+#ifdef LDWS_CUDA
+	version += ", CUDA";
+#endif
+	return version + ")";
+}
+
 void ConfigStore::ParseCmdLine(int argc, char* argv[]) {
 	try {
-		TCLAP::CmdLine cmd_line("Lane Departure Warning System", ' ', LDWS_VERSION);
+		TCLAP::CmdLine cmd_line("Lane Departure Warning System", ' ', BuildVersion());
 		// FIXME CUDA and OpenCL should be mutually exclusive switches
 		TCLAP::SwitchArg enable_cuda_switch("u","enable-cuda","Enable CUDA support", cmd_line, false);
 		TCLAP::SwitchArg enable_opencl_switch("o","enable-opencl","Enable OpenCL support", cmd_line, false);
@@ -36,8 +48,28 @@ void ConfigStore::ParseCmdLine(int argc, char* argv[]) {
 		TCLAP::SwitchArg display_intermediate_switch("i","display-intermediate","Display intermediate processing steps", cmd_line, false);
 		TCLAP::SwitchArg write_video_switch("w","write-video","Write video to a file", cmd_line, false);
 		TCLAP::SwitchArg verbose_switch("v","verbose","Verbose messages", cmd_line, false);
+		TCLAP::SwitchArg realtime_switch("r","realtime","Keep up with the input: drop stale frames and lower quality to meet frame_budget_ms", cmd_line, false);
+		TCLAP::SwitchArg verify_kernels_switch("","verify-kernels","Check hand-written kernels against the OpenCV reference on every frame", cmd_line, false);
 		TCLAP::ValueArg<string> config_file_string("c","config-file","Configuration file name", false, "ldws.conf", "filename");
 		cmd_line.add(config_file_string);
+		TCLAP::ValueArg<int> threads_int("t","threads","Number of detection worker threads", false, 2, "count");
+		cmd_line.add(threads_int);
+		TCLAP::ValueArg<string> batch_string("b","batch","Process a list file or glob pattern of input videos", false, "", "list|glob");
+		cmd_line.add(batch_string);
+		TCLAP::ValueArg<string> batch_out_string("","batch-out","Directory for per-clip batch results", false, ".", "directory");
+		cmd_line.add(batch_out_string);
+		TCLAP::ValueArg<string> batch_ref_string("","batch-ref","Directory of earlier batch results to compare the lanes against", false, "", "directory");
+		cmd_line.add(batch_ref_string);
+		TCLAP::ValueArg<float> batch_max_error_float("","batch-max-error","Fail when the mean lane offset error against --batch-ref exceeds this", false, 0, "pixels");
+		cmd_line.add(batch_max_error_float);
+		TCLAP::ValueArg<float> batch_min_fps_float("","batch-min-fps","Fail when the aggregate batch FPS is below this", false, 0, "fps");
+		cmd_line.add(batch_min_fps_float);
+		TCLAP::ValueArg<int> jobs_int("j","jobs","Number of clips processed in parallel in batch mode", false, 0, "count");
+		cmd_line.add(jobs_int);
+		TCLAP::ValueArg<string> stats_out_string("","stats-out","Write per-stage latency statistics (JSON, or CSV for *.csv) at exit", false, "", "filename");
+		cmd_line.add(stats_out_string);
+		TCLAP::ValueArg<string> record_trace_string("","record-trace","Record what lane tracking consumes per frame for ldws-replay", false, "", "filename");
+		cmd_line.add(record_trace_string);
 		cmd_line.parse(argc, argv);
 
 		intermediate_display = display_intermediate_switch.getValue();
@@ -47,6 +79,24 @@ void ConfigStore::ParseCmdLine(int argc, char* argv[]) {
 		file_write = write_video_switch.getValue();
 		verbose = verbose_switch.getValue();
 		config_file = config_file_string.getValue();
+		threads = threads_int.getValue();
+		batch_input = batch_string.getValue();
+		batch_output_dir = batch_out_string.getValue();
+		batch_reference_dir = batch_ref_string.getValue();
+		batch_max_error = batch_max_error_float.getValue();
+		batch_min_fps = batch_min_fps_float.getValue();
+		jobs = jobs_int.getValue();
+		stats_out = stats_out_string.getValue();
+		record_trace = record_trace_string.getValue();
+		verify_kernels = verify_kernels_switch.getValue();
+		realtime = realtime_switch.getValue();
+		headless = !display_enabled && !intermediate_display && !file_write;
+#ifndef LDWS_CUDA
+		if (cuda_enabled) {
+			std::cerr << "warning: built without CUDA, --enable-cuda is ignored" << std::endl;
+			cuda_enabled = false;
+		}
+#endif
 	} catch (TCLAP::ArgException &e) {
 		std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
 	}
@@ -57,6 +107,8 @@ void ConfigStore::ParseCfgFile() {
 	cfg.readFile(config_file.c_str());
 	cfg.lookupValue("video_input_file", video_in);
 	cfg.lookupValue("video_output_file", video_out);
+	cfg.lookupValue("video_input_size.w", video_in_size.w);
+	cfg.lookupValue("video_input_size.h", video_in_size.h);
 	cfg.lookupValue("region_of_interest.x", roi.x);
 	cfg.lookupValue("region_of_interest.y", roi.y);
 	cfg.lookupValue("region_of_interest.w", roi.w);
@@ -67,6 +119,26 @@ void ConfigStore::ParseCfgFile() {
 	cfg.lookupValue("hough_thresh", hough_thresh);
 	cfg.lookupValue("hough_min_length", hough_min_length);
 	cfg.lookupValue("hough_max_gap", hough_max_gap);
+	cfg.lookupValue("hough_engine", hough_engine);
+	cfg.lookupValue("birdseye_top_ratio", birdseye_top_ratio);
+	cfg.lookupValue("fused_gray_blur", fused_gray_blur);
+	cfg.lookupValue("roi_narrowing", roi_narrowing);
+	cfg.lookupValue("band_margin", band_margin);
+	cfg.lookupValue("pyramid_levels", pyramid_levels);
+	cfg.lookupValue("keyframe_interval", keyframe_interval);
+	cfg.lookupValue("tracker_beta", tracker_beta);
+	cfg.lookupValue("departure_margin", departure_margin);
+	cfg.lookupValue("vehicle_center_offset", vehicle_center_offset);
+	cfg.lookupValue("alert_socket", alert_socket);
+	cfg.lookupValue("frame_budget_ms", frame_budget_ms);
+	cfg.lookupValue("video_codec", video_codec);
+	cfg.lookupValue("video_fps", video_fps);
+	cfg.lookupValue("encoder_queue", encoder_queue);
+	cfg.lookupValue("encoder_overflow", encoder_overflow);
+	cfg.lookupValue("telemetry_shm", telemetry_shm);
+	cfg.lookupValue("edge_runs", edge_runs);
+	cfg.lookupValue("side_parallel", side_parallel);
+	cfg.lookupValue("side_overlap", side_overlap);
 }
 
 void ConfigStore::ParseConfig(int argc, char* argv[])
@@ -75,6 +147,12 @@ void ConfigStore::ParseConfig(int argc, char* argv[])
 	ParseCfgFile();
 }
 
+void ConfigStore::ParseConfigFile(const string& name)
+{
+	config_file = name;
+	ParseCfgFile();
+}
+
 ConfigStore::ConfigStore()
 {
 	// Command line settings
@@ -84,11 +162,24 @@ ConfigStore::ConfigStore()
 	display_enabled = true;
 	file_write = false;
 	verbose = false;
+	threads = 2;
+	batch_input = "";
+	batch_output_dir = ".";
+	batch_reference_dir = "";
+	batch_max_error = 0;
+	batch_min_fps = 0;
+	jobs = 0;
+	stats_out = "";
+	record_trace = "";
+	verify_kernels = false;
+	headless = false;
+	realtime = false;
 	config_file = "ldws.conf";
 
 	// Config file settings
 	video_in = "ldws-in.avi";
 	video_out = "ldws-out.avi";
+	video_in_size.w = 0; video_in_size.h = 0;
 	roi.x = 0; roi.y=0; roi.w=0; roi.h=0;
 	line_reject_degrees = 30;
 	canny_min_thresh = 70;
@@ -96,6 +187,8 @@ ConfigStore::ConfigStore()
 	hough_thresh = 50;
 	hough_min_length = 50;
 	hough_max_gap = 100;
+	hough_engine = "opencv";
+	birdseye_top_ratio = 0.3f;
 	scan_step = 5;
 	bw_thresh = 250;
 	borderx = 10;
@@ -103,6 +196,24 @@ ConfigStore::ConfigStore()
 	k_vary_factor = 0.2f;
 	b_vary_factor = 20;
 	max_lost_frames = 30;
+	fused_gray_blur = true;
+	roi_narrowing = true;
+	band_margin = 30;
+	pyramid_levels = 0;
+	keyframe_interval = 0;
+	tracker_beta = 0.05f;
+	departure_margin = 60;
+	vehicle_center_offset = 0;
+	alert_socket = "";
+	frame_budget_ms = 33;
+	video_codec = "PIM1";
+	video_fps = 30;
+	encoder_queue = 8;
+	encoder_overflow = "block";
+	telemetry_shm = "";
+	edge_runs = true;
+	side_parallel = false;
+	side_overlap = 16;
 }
 
 ConfigStore *ConfigStore::instance = NULL;
@@ -22,8 +22,17 @@
 class ConfigStore
 {
 	public:
+		// Shared instance of the ldws application; library users
+		// configure each detector with a ConfigStore of their own
 		static ConfigStore* GetInstance();
+		ConfigStore();
 		void ParseConfig(int argc, char *argv[]);
+		// Loads only the config file settings, for tools with their own
+		// command line
+		void ParseConfigFile(const std::string& name);
+		// Version with the kernel variant in use and the optional
+		// backends built in, for --version
+		static std::string BuildVersion();
 
 		// Command line settings
 		bool intermediate_display;
@@ -32,11 +41,27 @@ class ConfigStore
 		bool display_enabled;
 		bool file_write;
 		bool verbose;
+		int threads;
+		std::string batch_input;
+		std::string batch_output_dir;
+		std::string batch_reference_dir;
+		float batch_max_error;  // mean |db| against the reference, 0 for no limit
+		float batch_min_fps;    // 0 for no limit
+		int jobs;
+		std::string stats_out;
+		std::string record_trace;
+		bool verify_kernels;
+		bool headless;          // no display, intermediate view or video output
+		bool realtime;
 		std::string config_file;
 
 		// Config file settings
 		std::string video_in;
 		std::string video_out;
+		struct size_struct {
+			int w;
+			int h;
+		} video_in_size;
 		struct roi_struct {
 			int x;
 			int y;
@@ -49,6 +74,8 @@ class ConfigStore
 		int hough_thresh;
 		int hough_min_length;
 		int hough_max_gap;
+		std::string hough_engine;
+		float birdseye_top_ratio;       // road width at the ROI top / bottom
 		int scan_step;
 		int bw_thresh;
 		int borderx;
@@ -56,10 +83,27 @@ class ConfigStore
 		float k_vary_factor;
 		int b_vary_factor;
 		int max_lost_frames;
+		bool fused_gray_blur;
+		bool roi_narrowing;
+		int band_margin;
+		int pyramid_levels;
+		int keyframe_interval;
+		float tracker_beta;
+		int departure_margin;
+		int vehicle_center_offset;
+		std::string alert_socket;
+		int frame_budget_ms;
+		std::string video_codec;        // fourcc of video_out
+		int video_fps;
+		int encoder_queue;              // frames buffered for the encoder
+		std::string encoder_overflow;   // "block" or "drop"
+		std::string telemetry_shm;      // POSIX shared memory name, e.g. "/ldws"
+		bool edge_runs;                 // hand the edge map on as pixel runs
+		bool side_parallel;             // detect the two ROI halves on two threads
+		int side_overlap;               // pixels each half reaches past the middle
 
 	private:
 		static ConfigStore* instance;
-		ConfigStore();
 		void ParseCmdLine(int argc, char *argv[]);
 		void ParseCfgFile();
 
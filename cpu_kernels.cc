@@ -0,0 +1,143 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <iostream>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "config.h"
+#include "cpu_kernels.h"
+
+using namespace std;
+
+static int first_above_scalar(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	for (int x = begin; x < end; x++)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+static int last_above_scalar(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	for (int x = end - 1; x >= begin; x--)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+// All kernel files are built with -ffp-contract=off, so the products
+// are not fused into the sum and round the same in every variant
+static void rho_bins_scalar(float x, float y, const float *cos_tab, const float *sin_tab, int offset, int n, int *out)
+{
+	for (int i = 0; i < n; i++) {
+		float a = x * cos_tab[i];
+		float b = y * sin_tab[i];
+		out[i] = (int)lrintf(a + b) + offset;
+	}
+}
+
+static void tint_scalar(uint8_t *p, int n, const uint16_t *pattern)
+{
+	for (int i = 0; i < n; i++) {
+		int v = (p[i] * 115 + pattern[i % 3]) >> 7;
+		p[i] = v > 255 ? 255 : v;
+	}
+}
+
+static void bgr_to_gray_scalar(const uint8_t *bgr, uint8_t *gray, int n)
+{
+	for (int x = 0; x < n; x++, bgr += 3)
+		gray[x] = (bgr[0] * GRAY_B + bgr[1] * GRAY_G + bgr[2] * GRAY_R + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT;
+}
+
+static const CpuKernels cpu_kernels_scalar = {
+	"scalar", first_above_scalar, last_above_scalar, rho_bins_scalar, tint_scalar, bgr_to_gray_scalar
+};
+
+#if defined(LDWS_KERNELS_X86)
+// The OS has to save the wider registers on context switches as well
+static bool os_saves(uint64_t states)
+{
+	uint32_t lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((((uint64_t)hi << 32) | lo) & states) == states;
+}
+#endif
+
+// Supported variants, best last
+static int supported_kernels(const CpuKernels **list)
+{
+	int n = 0;
+	list[n++] = &cpu_kernels_scalar;
+#if defined(LDWS_KERNELS_X86)
+	unsigned a, b, c, d;
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return n;
+	bool sse42 = c & bit_SSE4_2;
+	bool avx = (c & bit_OSXSAVE) && (c & bit_AVX) && os_saves(0x6);
+	unsigned b7 = 0;
+	if (__get_cpuid_max(0, NULL) >= 7) {
+		__cpuid_count(7, 0, a, b, c, d);
+		b7 = b;
+	}
+	bool avx2 = avx && (b7 & bit_AVX2);
+	// Mask registers and the upper ZMM state
+	bool avx512 = avx && (b7 & bit_AVX512F) && (b7 & bit_AVX512BW) && os_saves(0xe6);
+	if (sse42)
+		list[n++] = &cpu_kernels_sse42;
+	if (avx2)
+		list[n++] = &cpu_kernels_avx2;
+	if (avx512)
+		list[n++] = &cpu_kernels_avx512;
+#elif defined(LDWS_KERNELS_NEON)
+	// Part of every AArch64 CPU
+	list[n++] = &cpu_kernels_neon;
+#endif
+	return n;
+}
+
+static const CpuKernels* select_kernels()
+{
+	const CpuKernels *list[8];
+	int n = supported_kernels(list);
+	const CpuKernels *k = list[n - 1];
+
+	const char *name = getenv("LDWS_KERNELS");
+	if (name && *name) {
+		int i = 0;
+		while (i < n && strcmp(list[i]->name, name) != 0)
+			i++;
+		if (i < n)
+			k = list[i];
+		else
+			cerr << "warning: " << name << " kernels are not supported here, using " << k->name << endl;
+	}
+	return k;
+}
+
+const CpuKernels& GetCpuKernels()
+{
+	// Picked on first use, thread safe since C++11
+	static const CpuKernels *kernels = select_kernels();
+	return *kernels;
+}
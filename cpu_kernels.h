@@ -0,0 +1,69 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef CPU_KERNELS_H
+#define CPU_KERNELS_H
+
+#include <stdint.h>
+
+// Entries of the pattern passed to tint, enough for the widest variant
+static const int TINT_PATTERN = 96;
+
+// cvtColor BGR2GRAY fixed point weights, 14 fractional bits
+static const int GRAY_SHIFT = 14;
+static const int GRAY_B = 1868;
+static const int GRAY_G = 9617;
+static const int GRAY_R = 4899;
+
+// The hand-written hot loops, built for several instruction sets. The
+// best set the CPU supports is picked once at startup, or the one named
+// by the LDWS_KERNELS environment variable if the CPU has it. All
+// variants give exactly the same results.
+struct CpuKernels {
+	const char *name;
+
+	// Lowest / highest index in [begin, end) with p[i] > t, or -1
+	int (*first_above)(const uint8_t *p, int begin, int end, uint8_t t);
+	int (*last_above)(const uint8_t *p, int begin, int end, uint8_t t);
+
+	// Hough bins of point (x, y): out[i] = lrint(x * cos_tab[i] +
+	// y * sin_tab[i]) + offset, with the products rounded separately.
+	// n is a multiple of 16.
+	void (*rho_bins)(float x, float y, const float *cos_tab, const float *sin_tab, int offset, int n, int *out);
+
+	// Lane overlay blend of n bytes of BGR pixels starting at a pixel:
+	// p[i] = min((p[i] * 115 + pattern[i % 3]) >> 7, 255), where
+	// pattern holds color * 64 + 64 for each channel, repeated
+	void (*tint)(uint8_t *p, int n, const uint16_t *pattern);
+
+	// n BGR pixels to gray like cvtColor(CV_BGR2GRAY) on 8 bits:
+	// (b * GRAY_B + g * GRAY_G + r * GRAY_R + 2^13) >> GRAY_SHIFT
+	void (*bgr_to_gray)(const uint8_t *bgr, uint8_t *gray, int n);
+};
+
+const CpuKernels& GetCpuKernels();
+
+// Variants of the other instruction sets, only those the build has
+extern const CpuKernels cpu_kernels_sse42;
+extern const CpuKernels cpu_kernels_avx2;
+extern const CpuKernels cpu_kernels_avx512;
+extern const CpuKernels cpu_kernels_neon;
+
+// Shared by all x86 variants, wider shuffles stay within 128 bit lanes
+// and gain nothing on three channel pixels
+void bgr_to_gray_sse42(const uint8_t *bgr, uint8_t *gray, int n);
+
+#endif // CPU_KERNELS_H
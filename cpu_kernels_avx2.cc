@@ -0,0 +1,99 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// Built with -mavx2, see cpu_kernels_sse42.cc
+
+#include <stdint.h>
+
+#include "config.h"
+#include "cpu_kernels.h"
+
+#if defined(LDWS_KERNELS_X86)
+#include <immintrin.h>
+
+static int first_above_avx2(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	int x = begin;
+	const __m256i vt = _mm256_set1_epi8((char)t);
+	const __m256i zero = _mm256_setzero_si256();
+	for (; x + 32 <= end; x += 32) {
+		__m256i v = _mm256_subs_epu8(_mm256_loadu_si256((const __m256i*)(p + x)), vt);
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+		if (mask)
+			return x + __builtin_ctz(mask);
+	}
+	for (; x < end; x++)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+static int last_above_avx2(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	int x = end;
+	const __m256i vt = _mm256_set1_epi8((char)t);
+	const __m256i zero = _mm256_setzero_si256();
+	for (; x - 32 >= begin; x -= 32) {
+		__m256i v = _mm256_subs_epu8(_mm256_loadu_si256((const __m256i*)(p + x - 32)), vt);
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+		if (mask)
+			return x - 32 + 31 - __builtin_clz(mask);
+	}
+	for (x--; x >= begin; x--)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+// No FMA, the sum is rounded after the products like everywhere else
+static void rho_bins_avx2(float x, float y, const float *cos_tab, const float *sin_tab, int offset, int n, int *out)
+{
+	__m256 vx = _mm256_set1_ps(x);
+	__m256 vy = _mm256_set1_ps(y);
+	__m256i off = _mm256_set1_epi32(offset);
+	for (int i = 0; i < n; i += 8) {
+		__m256 r = _mm256_add_ps(_mm256_mul_ps(vx, _mm256_loadu_ps(cos_tab + i)),
+				_mm256_mul_ps(vy, _mm256_loadu_ps(sin_tab + i)));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(_mm256_cvtps_epi32(r), off));
+	}
+}
+
+static void tint_avx2(uint8_t *p, int n, const uint16_t *pattern)
+{
+	const __m256i w = _mm256_set1_epi16(115);
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		const uint16_t *a = pattern + i % 3;
+		__m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + i)));
+		__m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + i + 16)));
+		lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, w),
+					_mm256_loadu_si256((const __m256i*)a)), 7);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, w),
+					_mm256_loadu_si256((const __m256i*)(a + 16))), 7);
+		// packus works per 128 bit lane, put the quarters back in order
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8);
+		_mm256_storeu_si256((__m256i*)(p + i), v);
+	}
+	for (; i < n; i++) {
+		int v = (p[i] * 115 + pattern[i % 3]) >> 7;
+		p[i] = v > 255 ? 255 : v;
+	}
+}
+
+const CpuKernels cpu_kernels_avx2 = {
+	"avx2", first_above_avx2, last_above_avx2, rho_bins_avx2, tint_avx2, bgr_to_gray_sse42
+};
+#endif
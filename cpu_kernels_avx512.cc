@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// Built with -mavx512f -mavx512bw, see cpu_kernels_sse42.cc
+
+#include <stdint.h>
+
+#include "config.h"
+#include "cpu_kernels.h"
+
+#if defined(LDWS_KERNELS_X86)
+#include <immintrin.h>
+
+// AVX-512BW has unsigned byte compares into mask registers, and masked
+// loads take the tail without touching memory past it
+
+static int first_above_avx512(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	const __m512i vt = _mm512_set1_epi8((char)t);
+	for (int x = begin; x < end; x += 64) {
+		__mmask64 valid = end - x >= 64 ? ~0ULL : (1ULL << (end - x)) - 1;
+		__mmask64 m = _mm512_mask_cmpgt_epu8_mask(valid, _mm512_maskz_loadu_epi8(valid, p + x), vt);
+		if (m)
+			return x + __builtin_ctzll(m);
+	}
+	return -1;
+}
+
+static int last_above_avx512(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	const __m512i vt = _mm512_set1_epi8((char)t);
+	for (int x = end; x > begin; x -= 64) {
+		// Bytes [x - 64, x), the part below begin masked off
+		int n = x - begin >= 64 ? 64 : x - begin;
+		__mmask64 valid = n == 64 ? ~0ULL : ~((1ULL << (64 - n)) - 1);
+		__mmask64 m = _mm512_mask_cmpgt_epu8_mask(valid, _mm512_maskz_loadu_epi8(valid, p + x - 64), vt);
+		if (m)
+			return x - 64 + 63 - __builtin_clzll(m);
+	}
+	return -1;
+}
+
+static void rho_bins_avx512(float x, float y, const float *cos_tab, const float *sin_tab, int offset, int n, int *out)
+{
+	__m512 vx = _mm512_set1_ps(x);
+	__m512 vy = _mm512_set1_ps(y);
+	__m512i off = _mm512_set1_epi32(offset);
+	for (int i = 0; i < n; i += 16) {
+		__m512 r = _mm512_add_ps(_mm512_mul_ps(vx, _mm512_loadu_ps(cos_tab + i)),
+				_mm512_mul_ps(vy, _mm512_loadu_ps(sin_tab + i)));
+		_mm512_storeu_si512(out + i, _mm512_add_epi32(_mm512_cvtps_epi32(r), off));
+	}
+}
+
+static void tint_avx512(uint8_t *p, int n, const uint16_t *pattern)
+{
+	const __m512i w = _mm512_set1_epi16(115);
+	for (int i = 0; i < n; i += 32) {
+		const uint16_t *a = pattern + i % 3;
+		// 32 bytes widen to 32 words, through the 512 bit masked moves
+		// so VL is not needed
+		__mmask64 valid = n - i >= 32 ? 0xffffffffULL : (1ULL << (n - i)) - 1;
+		__m256i d = _mm512_castsi512_si256(_mm512_maskz_loadu_epi8(valid, p + i));
+		__m512i v = _mm512_srli_epi16(_mm512_add_epi16(_mm512_mullo_epi16(_mm512_cvtepu8_epi16(d), w),
+					_mm512_loadu_si512(a)), 7);
+		_mm512_mask_storeu_epi8(p + i, valid, _mm512_castsi256_si512(_mm512_cvtusepi16_epi8(v)));
+	}
+}
+
+const CpuKernels cpu_kernels_avx512 = {
+	"avx512", first_above_avx512, last_above_avx512, rho_bins_avx512, tint_avx512, bgr_to_gray_sse42
+};
+#endif
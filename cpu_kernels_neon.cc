@@ -0,0 +1,120 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// AArch64 NEON, see cpu_kernels_sse42.cc
+
+#include <stdint.h>
+
+#include "config.h"
+#include "cpu_kernels.h"
+
+#if defined(LDWS_KERNELS_NEON)
+#include <arm_neon.h>
+
+// NEON has no movemask. Narrowing the compare result by 4 bits per
+// 16 bit lane leaves a nibble per byte in a 64 bit value instead.
+static inline uint64_t nibble_mask(uint8x16_t m)
+{
+	return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+static int first_above_neon(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	int x = begin;
+	const uint8x16_t vt = vdupq_n_u8(t);
+	for (; x + 16 <= end; x += 16) {
+		uint64_t m = nibble_mask(vcgtq_u8(vld1q_u8(p + x), vt));
+		if (m)
+			return x + (__builtin_ctzll(m) >> 2);
+	}
+	for (; x < end; x++)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+static int last_above_neon(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	int x = end;
+	const uint8x16_t vt = vdupq_n_u8(t);
+	for (; x - 16 >= begin; x -= 16) {
+		uint64_t m = nibble_mask(vcgtq_u8(vld1q_u8(p + x - 16), vt));
+		if (m)
+			return x - 16 + ((63 - __builtin_clzll(m)) >> 2);
+	}
+	for (x--; x >= begin; x--)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+// vmul + vadd rather than vfma, so the sum rounds like on x86
+static void rho_bins_neon(float x, float y, const float *cos_tab, const float *sin_tab, int offset, int n, int *out)
+{
+	float32x4_t vx = vdupq_n_f32(x);
+	float32x4_t vy = vdupq_n_f32(y);
+	int32x4_t off = vdupq_n_s32(offset);
+	for (int i = 0; i < n; i += 4) {
+		float32x4_t r = vaddq_f32(vmulq_f32(vx, vld1q_f32(cos_tab + i)), vmulq_f32(vy, vld1q_f32(sin_tab + i)));
+		vst1q_s32(out + i, vaddq_s32(vcvtnq_s32_f32(r), off));
+	}
+}
+
+static void tint_neon(uint8_t *p, int n, const uint16_t *pattern)
+{
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const uint16_t *a = pattern + i % 3;
+		uint8x16_t d = vld1q_u8(p + i);
+		uint16x8_t lo = vshrq_n_u16(vmlaq_n_u16(vld1q_u16(a), vmovl_u8(vget_low_u8(d)), 115), 7);
+		uint16x8_t hi = vshrq_n_u16(vmlaq_n_u16(vld1q_u16(a + 8), vmovl_u8(vget_high_u8(d)), 115), 7);
+		vst1q_u8(p + i, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+	}
+	for (; i < n; i++) {
+		int v = (p[i] * 115 + pattern[i % 3]) >> 7;
+		p[i] = v > 255 ? 255 : v;
+	}
+}
+
+// vld3 deinterleaves the channels, the weighted sum is widened to 32 bits
+static void bgr_to_gray_neon(const uint8_t *bgr, uint8_t *gray, int n)
+{
+	int x = 0;
+	for (; x + 8 <= n; x += 8) {
+		uint8x8x3_t v = vld3_u8(bgr + x * 3);
+		uint16x8_t b = vmovl_u8(v.val[0]);
+		uint16x8_t g = vmovl_u8(v.val[1]);
+		uint16x8_t r = vmovl_u8(v.val[2]);
+		uint32x4_t lo = vdupq_n_u32(1 << (GRAY_SHIFT - 1));
+		uint32x4_t hi = lo;
+		lo = vmlal_n_u16(lo, vget_low_u16(b), GRAY_B);
+		hi = vmlal_n_u16(hi, vget_high_u16(b), GRAY_B);
+		lo = vmlal_n_u16(lo, vget_low_u16(g), GRAY_G);
+		hi = vmlal_n_u16(hi, vget_high_u16(g), GRAY_G);
+		lo = vmlal_n_u16(lo, vget_low_u16(r), GRAY_R);
+		hi = vmlal_n_u16(hi, vget_high_u16(r), GRAY_R);
+		vst1_u8(gray + x, vmovn_u16(vcombine_u16(vshrn_n_u32(lo, GRAY_SHIFT), vshrn_n_u32(hi, GRAY_SHIFT))));
+	}
+	for (; x < n; x++) {
+		const uint8_t *p = bgr + x * 3;
+		gray[x] = (p[0] * GRAY_B + p[1] * GRAY_G + p[2] * GRAY_R + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT;
+	}
+}
+
+const CpuKernels cpu_kernels_neon = {
+	"neon", first_above_neon, last_above_neon, rho_bins_neon, tint_neon, bgr_to_gray_neon
+};
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// Built with -msse4.2. Like the other variants this file includes no
+// C++ library headers: inline functions instantiated here could be
+// picked by the linker for code that runs on any CPU.
+
+#include <stdint.h>
+
+#include "config.h"
+#include "cpu_kernels.h"
+
+#if defined(LDWS_KERNELS_X86)
+#include <nmmintrin.h>
+
+// Pixels are white when above the threshold. There is no unsigned byte
+// compare before AVX-512, but p > t is the same as (p -sat t) != 0.
+
+static int first_above_sse42(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	int x = begin;
+	const __m128i vt = _mm_set1_epi8((char)t);
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 16 <= end; x += 16) {
+		__m128i v = _mm_subs_epu8(_mm_loadu_si128((const __m128i*)(p + x)), vt);
+		// All black is the common case, one PTEST answers it
+		if (_mm_testz_si128(v, v))
+			continue;
+		unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xffff;
+		return x + __builtin_ctz(mask);
+	}
+	for (; x < end; x++)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+static int last_above_sse42(const uint8_t *p, int begin, int end, uint8_t t)
+{
+	int x = end;
+	const __m128i vt = _mm_set1_epi8((char)t);
+	const __m128i zero = _mm_setzero_si128();
+	for (; x - 16 >= begin; x -= 16) {
+		__m128i v = _mm_subs_epu8(_mm_loadu_si128((const __m128i*)(p + x - 16)), vt);
+		if (_mm_testz_si128(v, v))
+			continue;
+		unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xffff;
+		return x - 16 + 31 - __builtin_clz(mask);
+	}
+	for (x--; x >= begin; x--)
+		if (p[x] > t)
+			return x;
+	return -1;
+}
+
+static void rho_bins_sse42(float x, float y, const float *cos_tab, const float *sin_tab, int offset, int n, int *out)
+{
+	__m128 vx = _mm_set1_ps(x);
+	__m128 vy = _mm_set1_ps(y);
+	__m128i off = _mm_set1_epi32(offset);
+	for (int i = 0; i < n; i += 4) {
+		__m128 r = _mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(cos_tab + i)), _mm_mul_ps(vy, _mm_loadu_ps(sin_tab + i)));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(_mm_cvtps_epi32(r), off));
+	}
+}
+
+static void tint_sse42(uint8_t *p, int n, const uint16_t *pattern)
+{
+	const __m128i w = _mm_set1_epi16(115);
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const uint16_t *a = pattern + i % 3;
+		__m128i d = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i lo = _mm_cvtepu8_epi16(d);
+		__m128i hi = _mm_unpackhi_epi8(d, zero);
+		lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, w), _mm_loadu_si128((const __m128i*)a)), 7);
+		hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, w), _mm_loadu_si128((const __m128i*)(a + 8))), 7);
+		_mm_storeu_si128((__m128i*)(p + i), _mm_packus_epi16(lo, hi));
+	}
+	for (; i < n; i++) {
+		int v = (p[i] * 115 + pattern[i % 3]) >> 7;
+		p[i] = v > 255 ? 255 : v;
+	}
+}
+
+// Deinterleaves 16 pixels per iteration, then uses madd on (b, g) and
+// (r, 1) pairs so the rounding constant rides along with red
+void bgr_to_gray_sse42(const uint8_t *bgr, uint8_t *gray, int n)
+{
+	const __m128i sb0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i sb1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+	const __m128i sb2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+	const __m128i sg0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i sg1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+	const __m128i sg2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+	const __m128i sr0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i sr1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+	const __m128i sr2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+	const __m128i wbg = _mm_setr_epi16(GRAY_B, GRAY_G, GRAY_B, GRAY_G, GRAY_B, GRAY_G, GRAY_B, GRAY_G);
+	const __m128i wr = _mm_setr_epi16(GRAY_R, 1 << (GRAY_SHIFT - 1), GRAY_R, 1 << (GRAY_SHIFT - 1),
+			GRAY_R, 1 << (GRAY_SHIFT - 1), GRAY_R, 1 << (GRAY_SHIFT - 1));
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i zero = _mm_setzero_si128();
+
+	int x = 0;
+	for (; x + 16 <= n; x += 16) {
+		const uint8_t *p = bgr + x * 3;
+		__m128i a = _mm_loadu_si128((const __m128i*)p);
+		__m128i b = _mm_loadu_si128((const __m128i*)(p + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(p + 32));
+
+		__m128i bl = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, sb0), _mm_shuffle_epi8(b, sb1)), _mm_shuffle_epi8(c, sb2));
+		__m128i gr = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, sg0), _mm_shuffle_epi8(b, sg1)), _mm_shuffle_epi8(c, sg2));
+		__m128i rd = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, sr0), _mm_shuffle_epi8(b, sr1)), _mm_shuffle_epi8(c, sr2));
+
+		__m128i out[2];
+		for (int h = 0; h < 2; h++) {
+			__m128i b16 = h ? _mm_unpackhi_epi8(bl, zero) : _mm_unpacklo_epi8(bl, zero);
+			__m128i g16 = h ? _mm_unpackhi_epi8(gr, zero) : _mm_unpacklo_epi8(gr, zero);
+			__m128i r16 = h ? _mm_unpackhi_epi8(rd, zero) : _mm_unpacklo_epi8(rd, zero);
+
+			__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b16, g16), wbg),
+					_mm_madd_epi16(_mm_unpacklo_epi16(r16, one), wr));
+			__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b16, g16), wbg),
+					_mm_madd_epi16(_mm_unpackhi_epi16(r16, one), wr));
+			out[h] = _mm_packs_epi32(_mm_srli_epi32(lo, GRAY_SHIFT), _mm_srli_epi32(hi, GRAY_SHIFT));
+		}
+		_mm_storeu_si128((__m128i*)(gray + x), _mm_packus_epi16(out[0], out[1]));
+	}
+	for (; x < n; x++) {
+		const uint8_t *p = bgr + x * 3;
+		gray[x] = (p[0] * GRAY_B + p[1] * GRAY_G + p[2] * GRAY_R + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT;
+	}
+}
+
+const CpuKernels cpu_kernels_sse42 = {
+	"sse4.2", first_above_sse42, last_above_sse42, rho_bins_sse42, tint_sse42, bgr_to_gray_sse42
+};
+#endif
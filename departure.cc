@@ -0,0 +1,69 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <cmath>
+#include <opencv2/core.hpp>
+
+#include "config_store.h"
+#include "departure.h"
+#include "lane_detector.h"
+
+using namespace cv;
+
+// Distance beyond the margin a side has to get back to before it can
+// raise a new departure, so a marking right at the margin does not flap
+static const float DEPARTURE_HYSTERESIS = 5.f;
+
+int DepartureMonitor::Check(const LaneDetector& ld, int frame_width, long frame, int64 capture_tick,
+		DepartureEvent events[2])
+{
+	// Centerline and bottom row in ROI coordinates, like the lanes
+	float center = frame_width / 2 + cs->vehicle_center_offset - cs->roi.x;
+	float y = cs->roi.h - 1;
+	int count = 0;
+
+	for (int s = 0; s < 2; s++) {
+		LaneDetector::LaneState lane = ld.GetLaneState(s == 1);
+
+		// Nothing is known about a side that is not locked
+		if (lane.reset || lane.lost > 0 || !(fabs(lane.k) > 0.05f) || !std::isfinite(lane.b)) {
+			departing[s] = false;
+			continue;
+		}
+
+		float x = (y - lane.b) / lane.k;
+		float offset = (s == 1) ? x - center : center - x;
+
+		if (!departing[s] && offset < cs->departure_margin) {
+			departing[s] = true;
+			DepartureEvent& ev = events[count++];
+			ev.frame = frame;
+			ev.capture_tick = capture_tick;
+			ev.right = (s == 1);
+			ev.offset = offset;
+		} else if (departing[s] && offset > cs->departure_margin + DEPARTURE_HYSTERESIS) {
+			departing[s] = false;
+		}
+	}
+
+	return count;
+}
+
+DepartureMonitor::DepartureMonitor(const ConfigStore *cs)
+{
+	this->cs = cs;
+	departing[0] = departing[1] = false;
+}
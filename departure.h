@@ -0,0 +1,54 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef DEPARTURE_H
+#define DEPARTURE_H
+
+#include <opencv2/core.hpp>
+
+#include "config_store.h"
+#include "lane_detector.h"
+
+using namespace cv;
+
+struct DepartureEvent {
+	long frame;
+	int64 capture_tick;     // getTickCount() when the frame was read
+	bool right;             // side of the lane marking being crossed
+	float offset;           // centerline to marking distance in pixels,
+	                        // negative once the marking is crossed
+};
+
+// Watches the tracked lanes for the vehicle centerline coming within
+// departure_margin pixels of a lane marking, measured on the bottom row
+// of the ROI. An event is raised when a departure starts; the side has
+// to clear the margin again before it can raise another one.
+class DepartureMonitor
+{
+	public:
+		DepartureMonitor(const ConfigStore *cs);
+
+		// Returns the number of departures starting on this frame, at
+		// most one per side, and fills them into events
+		int Check(const LaneDetector& ld, int frame_width, long frame, int64 capture_tick,
+				DepartureEvent events[2]);
+
+	private:
+		const ConfigStore *cs;
+		bool departing[2];
+};
+
+#endif // DEPARTURE_H
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "cpu_kernels.h"
+#include "edge_runs.h"
+
+using namespace cv;
+using namespace std;
+
+// First non-zero index in [x, end), or end
+static int skip_zeros(const CpuKernels& k, const uchar *p, int x, int end)
+{
+	int nz = k.first_above(p, x, end, 0);
+	return nz < 0 ? end : nz;
+}
+
+void EdgeRuns::Build(const Mat& edge)
+{
+	CV_Assert(edge.type() == CV_8UC1);
+
+	size = edge.size();
+	runs.clear();
+	row_start.resize(size.height + 1);
+	pixels = 0;
+	const CpuKernels& k = GetCpuKernels();
+
+	for (int y = 0; y < size.height; y++) {
+		row_start[y] = runs.size();
+		const uchar *p = edge.ptr<uchar>(y);
+		int x = skip_zeros(k, p, 0, size.width);
+		while (x < size.width) {
+			// Edge runs are short, a pixel at a time is enough here
+			Run r;
+			r.begin = x;
+			while (x < size.width && p[x])
+				x++;
+			r.end = x;
+			runs.push_back(r);
+			pixels += r.end - r.begin;
+			x = skip_zeros(k, p, x, size.width);
+		}
+	}
+	row_start[size.height] = runs.size();
+}
+
+void EdgeRuns::Load(Size size, const uint16_t *row_runs, const uint16_t *pairs)
+{
+	this->size = size;
+	row_start.resize(size.height + 1);
+	int n = 0;
+	for (int y = 0; y < size.height; y++) {
+		row_start[y] = n;
+		n += row_runs[y];
+	}
+	row_start[size.height] = n;
+
+	runs.resize(n);
+	pixels = 0;
+	for (int i = 0; i < n; i++) {
+		runs[i].begin = pairs[2 * i];
+		runs[i].end = pairs[2 * i + 1];
+		pixels += runs[i].end - runs[i].begin;
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef EDGE_RUNS_H
+#define EDGE_RUNS_H
+
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+// An edge map as the runs of non-zero pixels of each row. Canny output
+// is almost all zeros, so the runs are a small fraction of its size and
+// later stages touch only the edge pixels. Made in one pass that skips
+// zero bytes with the vector kernels.
+class EdgeRuns
+{
+	public:
+		struct Run {
+			int begin, end;         // [begin, end) along the row
+		};
+
+		void Build(const Mat& edge);
+		// Takes runs stored elsewhere: the number of runs of each row,
+		// then all runs as (begin, end) pairs in row order
+		void Load(Size size, const uint16_t *row_runs, const uint16_t *pairs);
+
+		int Rows() const { return size.height; }
+		int Cols() const { return size.width; }
+		Size EdgeSize() const { return size; }
+		// Runs of row y in increasing x
+		const Run* RowBegin(int y) const { return runs.data() + row_start[y]; }
+		const Run* RowEnd(int y) const { return runs.data() + row_start[y + 1]; }
+		size_t Pixels() const { return pixels; }
+
+	private:
+		vector<Run> runs;
+		vector<int> row_start;      // rows + 1 offsets into runs
+		Size size;
+		size_t pixels;
+};
+
+#endif // EDGE_RUNS_H
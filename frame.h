@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+
+#include "edge_runs.h"
+#include "response_scan.h"
+
+using namespace cv;
+using namespace std;
+
+// Work reductions of the realtime mode, each level includes the ones
+// before it
+enum QualityLevel {
+	QUALITY_FULL,
+	QUALITY_COARSE_SCAN,    // twice the scan_step for the response search
+	QUALITY_HALF_SCALE,     // Canny and Hough on a half resolution ROI
+	QUALITY_SKIP_HOUGH,     // odd frames reuse the previous lines
+	NUM_QUALITY_LEVELS
+};
+
+// A captured frame and everything the detection stage produced for it.
+// Frames are recycled through a pool so the Mats keep their allocations.
+struct Frame {
+	Frame():left_lines(-1),index(0),capture_tick(0),quality(QUALITY_FULL),
+		hough_skipped(false),verify_only(false),scanned(false),last(false),image_ready(false){}
+
+	// Sources that decode to BGR fill image directly. YUV sources only
+	// map the planes; the BGR image is made on demand for rendering.
+	void EnsureImage() {
+		if (image_ready)
+			return;
+		if (yuv.rows == luma.rows)
+			cvtColor(yuv, image, CV_GRAY2BGR);
+		else
+			cvtColor(yuv, image, CV_YUV2BGR_I420);
+		image_ready = true;
+	}
+
+	// Width of the captured frame, also before a BGR image is made
+	int Width() const { return luma.empty() ? image.cols : luma.cols; }
+
+	// Responses found during detection, for LaneDetector
+	const ResponseScanner* Scan() const { return scanned ? &scan : NULL; }
+
+	Mat image;              // captured BGR frame
+	Mat yuv;                // I420 or mono planes, when the source has them
+	Mat luma;               // full frame Y plane, a view into yuv
+	Mat edge;               // Canny output for the ROI, empty when the
+	                        // OpenCL path only hands back the scan
+	vector<Vec4i> lines;    // Hough segments in ROI coordinates
+	int left_lines;         // leading left side lines, -1 if not sided
+	long index;
+	int64 capture_tick;     // getTickCount() when the frame was read
+	int quality;            // QualityLevel to detect the frame with
+	bool hough_skipped;     // no lines, reuse the previous frame's
+	bool verify_only;       // no lines, follow the tracked lanes instead
+	EdgeRuns runs;          // edge as runs, with edge_runs
+	ResponseScanner scan;
+	bool scanned;           // scan holds the responses of edge
+	bool last;              // end of stream marker
+	bool image_ready;
+};
+
+#endif // FRAME_H
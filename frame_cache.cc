@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config_store.h"
+#include "frame.h"
+#include "frame_cache.h"
+#include "frame_source.h"
+#include "gray_blur.h"
+
+using namespace cv;
+using namespace std;
+
+static const char CACHE_MAGIC[8] = { 'L', 'D', 'W', 'S', 'B', 'L', 'R', '1' };
+
+bool FrameCache::Build(const ConfigStore *cs, const string& path)
+{
+	FrameSource *source = FrameSource::Open(cs);
+	if (!source->IsOpened()) {
+		cerr << "error: cannot open " << cs->video_in << endl;
+		delete source;
+		return false;
+	}
+
+	Size frame_size = source->GetSize();
+	Rect roi_rect(cs->roi.x, cs->roi.y, cs->roi.w, cs->roi.h);
+	if (roi_rect.area() <= 0 || (roi_rect & Rect(Point(0, 0), frame_size)) != roi_rect) {
+		cerr << "error: ROI does not fit the " << frame_size.width << "x" << frame_size.height
+			<< " frames of " << cs->video_in << endl;
+		delete source;
+		return false;
+	}
+
+	// Written under a temporary name so a partial cache is never mapped
+	string tmp = path + ".tmp";
+	FILE *out = fopen(tmp.c_str(), "wb");
+	if (!out) {
+		cerr << "error: cannot write " << tmp << endl;
+		delete source;
+		return false;
+	}
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.frame_width = frame_size.width;
+	h.frame_height = frame_size.height;
+	h.roi_x = roi_rect.x;
+	h.roi_y = roi_rect.y;
+	h.roi_w = roi_rect.width;
+	h.roi_h = roi_rect.height;
+	h.fused = cs->fused_gray_blur;
+	bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+
+	// The same blur as the CPU paths of LineDetector
+	Frame f;
+	Mat gray;
+	while (ok && source->Read(&f)) {
+		if (!f.luma.empty()) {
+			GaussianBlur(Mat(f.luma, roi_rect), gray, Size(5, 5), 1.5, 0,
+					BORDER_DEFAULT | BORDER_ISOLATED);
+		} else if (cs->fused_gray_blur) {
+			BgrToGrayBlur(Mat(f.image, roi_rect), gray);
+		} else {
+			cvtColor(Mat(f.image, roi_rect), gray, CV_BGR2GRAY);
+			GaussianBlur(gray, gray, Size(5, 5), 1.5);
+		}
+		for (int y = 0; ok && y < gray.rows; y++)
+			ok = fwrite(gray.ptr<uchar>(y), gray.cols, 1, out) == 1;
+		h.frames++;
+	}
+	delete source;
+
+	// The frame count goes in last
+	ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, out) == 1;
+	ok = (fclose(out) == 0) && ok;
+	if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+		cerr << "error: cannot write " << path << endl;
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool FrameCache::Map(const ConfigStore *cs, const string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	const Header *h = (const Header*)map;
+	size_t frame_bytes = (size_t)h->roi_w * h->roi_h;
+	bool match = memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) == 0 &&
+		h->roi_x == cs->roi.x && h->roi_y == cs->roi.y &&
+		h->roi_w == cs->roi.w && h->roi_h == cs->roi.h &&
+		h->fused == (int32_t)cs->fused_gray_blur && h->frames >= 0 &&
+		(size_t)st.st_size == sizeof(Header) + h->frames * frame_bytes;
+	if (!match) {
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	data = (uchar*)map;
+	length = st.st_size;
+	frames = h->frames;
+	frame_width = h->frame_width;
+	size = Size(h->roi_w, h->roi_h);
+	return true;
+}
+
+bool FrameCache::Open(const ConfigStore *cs, const string& path)
+{
+	if (Map(cs, path))
+		return true;
+	return Build(cs, path) && Map(cs, path);
+}
+
+Mat FrameCache::Get(long i) const
+{
+	CV_Assert(data && i >= 0 && i < frames);
+	uchar *p = data + sizeof(Header) + (size_t)i * size.area();
+	return Mat(size, CV_8UC1, p);
+}
+
+FrameCache::FrameCache()
+	: data(NULL), length(0), frames(0), frame_width(0)
+{
+}
+
+FrameCache::~FrameCache()
+{
+	if (data)
+		munmap(data, length);
+}
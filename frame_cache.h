@@ -0,0 +1,72 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <opencv2/core.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "config_store.h"
+
+using namespace cv;
+using namespace std;
+
+// The blurred ROI luma of every frame of a clip, the input of Canny in
+// LineDetector, stored back to back in a file behind a small header. The
+// file is decoded once and then memory mapped read-only, so any number
+// of threads can share the frames without copies. A cache whose ROI or
+// blur does not match the configuration is rebuilt.
+class FrameCache
+{
+	public:
+		FrameCache();
+		~FrameCache();
+
+		// Maps path, building it from cs->video_in first if needed
+		bool Open(const ConfigStore *cs, const string& path);
+		bool IsOpened() const { return data != NULL; }
+
+		long Frames() const { return frames; }
+		// Width of the captured frames, for the lane side split
+		int FrameWidth() const { return frame_width; }
+		// Read-only view of frame i, the mapping is PROT_READ
+		Mat Get(long i) const;
+
+	private:
+		struct Header {
+			char magic[8];
+			int32_t frame_width, frame_height;
+			int32_t roi_x, roi_y, roi_w, roi_h;
+			int32_t fused;          // BGR input went through BgrToGrayBlur
+			int32_t reserved;
+			int64_t frames;
+			char pad[16];
+		};
+
+		bool Build(const ConfigStore *cs, const string& path);
+		bool Map(const ConfigStore *cs, const string& path);
+
+		uchar *data;
+		size_t length;
+		long frames;
+		int frame_width;
+		Size size;
+};
+
+#endif // FRAME_CACHE_H
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "config_store.h"
+#include "frame.h"
+#include "frame_source.h"
+
+using namespace cv;
+using namespace std;
+
+static bool has_extension(const string& name, const char *ext)
+{
+	size_t n = strlen(ext);
+	if (name.size() < n)
+		return false;
+	return strcasecmp(name.c_str() + name.size() - n, ext) == 0;
+}
+
+FrameSource* FrameSource::Open(const ConfigStore *cs)
+{
+	if (has_extension(cs->video_in, ".y4m"))
+		return new YuvFileSource(cs->video_in, Size(0, 0));
+	if (has_extension(cs->video_in, ".yuv"))
+		return new YuvFileSource(cs->video_in, Size(cs->video_in_size.w, cs->video_in_size.h));
+	return new CaptureSource(cs->video_in);
+}
+
+bool FrameSource::ExpandInputs(const string& spec, vector<string>& inputs)
+{
+	// A pattern is expanded directly, anything else is a list file with
+	// one input per line
+	if (spec.find_first_of("*?[") != string::npos) {
+		vector<String> matches;
+		glob(spec, matches, false);
+		for (size_t i = 0; i < matches.size(); i++)
+			inputs.push_back(matches[i]);
+		return true;
+	}
+
+	ifstream list(spec.c_str());
+	if (!list) {
+		cerr << "error: cannot open input list " << spec << endl;
+		return false;
+	}
+	string line;
+	while (getline(list, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		inputs.push_back(line);
+	}
+	return true;
+}
+
+CaptureSource::CaptureSource(const string& name)
+{
+	capture.open(name);
+	live = false;
+	// If file open fails, try finding a camera indicated by an integer argument
+	if (!capture.isOpened()) {
+		capture.open(atoi(name.c_str()));
+		live = true;
+	}
+}
+
+bool CaptureSource::Read(Frame *f)
+{
+	capture >> f->image;
+	f->image_ready = true;
+	f->capture_tick = getTickCount();
+	return !f->image.empty();
+}
+
+Size CaptureSource::GetSize() const
+{
+	return Size(capture.get(CV_CAP_PROP_FRAME_WIDTH), capture.get(CV_CAP_PROP_FRAME_HEIGHT));
+}
+
+string CaptureSource::GetCodec() const
+{
+	int ex = static_cast<int>(capture.get(CV_CAP_PROP_FOURCC));
+	char fourcc[] = {(char)(ex & 0XFF),(char)((ex & 0XFF00) >> 8),(char)((ex & 0XFF0000) >> 16),(char)((ex & 0XFF000000) >> 24),0};
+	return fourcc;
+}
+
+bool YuvFileSource::ParseY4mHeader()
+{
+	// YUV4MPEG2 W<width> H<height> [F.. I.. A.. C<colorspace> X..]\n
+	const char *magic = "YUV4MPEG2 ";
+	if (length < strlen(magic) || memcmp(data, magic, strlen(magic)) != 0)
+		return false;
+
+	size_t end = offset = strlen(magic);
+	while (end < length && data[end] != '\n')
+		end++;
+	if (end == length)
+		return false;
+
+	string colorspace = "420";
+	string header((const char*)data + offset, end - offset);
+	size_t pos = 0;
+	while (pos < header.size()) {
+		size_t next = header.find(' ', pos);
+		if (next == string::npos)
+			next = header.size();
+		string token = header.substr(pos, next - pos);
+		if (!token.empty()) {
+			if (token[0] == 'W')
+				size.width = atoi(token.c_str() + 1);
+			else if (token[0] == 'H')
+				size.height = atoi(token.c_str() + 1);
+			else if (token[0] == 'C')
+				colorspace = token.substr(1);
+		}
+		pos = next + 1;
+	}
+
+	// 8-bit 4:2:0 only, the chroma siting variants share the layout;
+	// C420p10 and the like have 16-bit samples
+	mono = (colorspace == "mono");
+	if (!mono && colorspace != "420" && colorspace != "420jpeg" &&
+			colorspace != "420paldv" && colorspace != "420mpeg2") {
+		cerr << "error: unsupported Y4M colorspace C" << colorspace << endl;
+		return false;
+	}
+
+	offset = end + 1;
+	return true;
+}
+
+YuvFileSource::YuvFileSource(const string& name, Size raw_size)
+	: data(NULL), length(0), offset(0), size(raw_size), mono(false)
+{
+	y4m = has_extension(name, ".y4m");
+
+	int fd = open(name.c_str(), O_RDONLY);
+	if (fd < 0) {
+		cerr << "error: cannot open " << name << endl;
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			data = (uchar*)map;
+			length = st.st_size;
+			madvise(map, length, MADV_SEQUENTIAL);
+		}
+	}
+	close(fd);
+
+	if (data && y4m && !ParseY4mHeader()) {
+		cerr << "error: bad Y4M header in " << name << endl;
+		munmap(data, length);
+		data = NULL;
+	}
+
+	// I420 needs even dimensions for the chroma planes
+	if (data && (size.width <= 0 || size.height <= 0 ||
+				(!mono && (size.width % 2 || size.height % 2)))) {
+		cerr << "error: invalid frame size " << size.width << "x" << size.height
+			<< " for " << name << endl;
+		munmap(data, length);
+		data = NULL;
+	}
+}
+
+YuvFileSource::~YuvFileSource()
+{
+	if (data)
+		munmap(data, length);
+}
+
+bool YuvFileSource::Read(Frame *f)
+{
+	if (y4m) {
+		// Every frame starts with a FRAME[ params]\n line
+		if (offset + 5 > length || memcmp(data + offset, "FRAME", 5) != 0)
+			return false;
+		while (offset < length && data[offset] != '\n')
+			offset++;
+		offset++;
+	}
+
+	int rows = mono ? size.height : size.height * 3 / 2;
+	size_t frame_bytes = (size_t)rows * size.width;
+	if (offset + frame_bytes > length)
+		return false;
+
+	// Views into the mapping, nothing is copied or converted here
+	f->yuv = Mat(rows, size.width, CV_8UC1, data + offset);
+	f->luma = f->yuv.rowRange(0, size.height);
+	f->image_ready = false;
+	f->capture_tick = getTickCount();
+	offset += frame_bytes;
+
+	return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "config_store.h"
+#include "frame.h"
+
+using namespace cv;
+using namespace std;
+
+// Input backend for video_input_file. Open() picks the backend from the
+// file extension: .y4m and .yuv (raw I420) files are memory mapped and
+// hand out their planes without a copy, anything else goes through
+// VideoCapture.
+class FrameSource
+{
+	public:
+		static FrameSource* Open(const ConfigStore *cs);
+		// Appends the inputs named by a glob pattern, or by a list file
+		// with one input per line
+		static bool ExpandInputs(const string& spec, vector<string>& inputs);
+		virtual ~FrameSource() {}
+
+		virtual bool IsOpened() const = 0;
+		// Fills in the next frame, returns false at end of stream
+		virtual bool Read(Frame *f) = 0;
+		virtual Size GetSize() const = 0;
+		virtual string GetCodec() const = 0;
+		// Cameras deliver frames at their own pace, files as fast as
+		// they are read
+		virtual bool IsLive() const { return false; }
+};
+
+class CaptureSource : public FrameSource
+{
+	public:
+		CaptureSource(const string& name);
+		bool IsOpened() const { return capture.isOpened(); }
+		bool Read(Frame *f);
+		Size GetSize() const;
+		string GetCodec() const;
+		bool IsLive() const { return live; }
+
+	private:
+		// VideoCapture::get() is not const
+		mutable VideoCapture capture;
+		bool live;
+};
+
+class YuvFileSource : public FrameSource
+{
+	public:
+		YuvFileSource(const string& name, Size raw_size);
+		~YuvFileSource();
+		bool IsOpened() const { return data != NULL; }
+		bool Read(Frame *f);
+		Size GetSize() const { return size; }
+		string GetCodec() const { return y4m ? "Y4M" : "I420"; }
+
+	private:
+		bool ParseY4mHeader();
+
+		uchar *data;
+		size_t length;
+		size_t offset;
+		Size size;
+		bool y4m;
+		bool mono;
+};
+
+#endif // FRAME_SOURCE_H
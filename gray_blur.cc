@@ -0,0 +1,182 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "cpu_kernels.h"
+#include "gray_blur.h"
+
+using namespace cv;
+using namespace std;
+
+// 5-tap Gaussian for sigma 1.5 with 8 fractional bits, the same weights
+// OpenCV derives for its bit-exact 8-bit filter. Both passes together
+// leave 16 fractional bits.
+static const int GAUSS_0 = 74;
+static const int GAUSS_1 = 60;
+static const int GAUSS_2 = 31;
+static const int PAD = 2;
+
+static inline int reflect101(int i, int n)
+{
+	if (n == 1)
+		return 0;
+	while (i < 0 || i >= n) {
+		if (i < 0)
+			i = -i;
+		if (i >= n)
+			i = 2 * n - 2 - i;
+	}
+	return i;
+}
+
+// Converts one BGR row to gray, leaving PAD reflected pixels on each side
+static void gray_row(const CpuKernels& k, const uchar* src, uchar* dst, int width)
+{
+	k.bgr_to_gray(src, dst + PAD, width);
+
+	for (int i = 1; i <= PAD; i++) {
+		dst[PAD - i] = dst[PAD + reflect101(-i, width)];
+		dst[PAD + width - 1 + i] = dst[PAD + reflect101(width - 1 + i, width)];
+	}
+}
+
+// Vertical pass over padded gray rows into 16-bit sums (<= 255 * 256)
+static void vert_row(const uchar* r0, const uchar* r1, const uchar* r2,
+		const uchar* r3, const uchar* r4, ushort* dst, int n)
+{
+	int x = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c0 = _mm_set1_epi16(GAUSS_0);
+	const __m128i c1 = _mm_set1_epi16(GAUSS_1);
+	const __m128i c2 = _mm_set1_epi16(GAUSS_2);
+
+	for (; x <= n - 16; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(r0 + x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(r1 + x));
+		__m128i c = _mm_loadu_si128((const __m128i*)(r2 + x));
+		__m128i d = _mm_loadu_si128((const __m128i*)(r3 + x));
+		__m128i e = _mm_loadu_si128((const __m128i*)(r4 + x));
+
+		__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), c0);
+		lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(d, zero)), c1));
+		lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(e, zero)), c2));
+
+		__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), c0);
+		hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(d, zero)), c1));
+		hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(e, zero)), c2));
+
+		_mm_storeu_si128((__m128i*)(dst + x), lo);
+		_mm_storeu_si128((__m128i*)(dst + x + 8), hi);
+	}
+#endif
+
+	for (; x < n; x++)
+		dst[x] = r2[x] * GAUSS_0 + (r1[x] + r3[x]) * GAUSS_1 + (r0[x] + r4[x]) * GAUSS_2;
+}
+
+// Horizontal pass from 16-bit sums to 8-bit output with rounding
+static void horiz_row(const ushort* src, uchar* dst, int width)
+{
+	int x = 0;
+
+#if defined(__SSE2__)
+	// 16 x 16 bit products are formed from mullo/mulhi halves
+	const __m128i c0 = _mm_set1_epi16(GAUSS_0);
+	const __m128i c1 = _mm_set1_epi16(GAUSS_1);
+	const __m128i c2 = _mm_set1_epi16(GAUSS_2);
+	const __m128i round = _mm_set1_epi32(1 << 15);
+
+	for (; x <= width - 8; x += 8) {
+		__m128i v0 = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i v1 = _mm_loadu_si128((const __m128i*)(src + x + 1));
+		__m128i v2 = _mm_loadu_si128((const __m128i*)(src + x + 2));
+		__m128i v3 = _mm_loadu_si128((const __m128i*)(src + x + 3));
+		__m128i v4 = _mm_loadu_si128((const __m128i*)(src + x + 4));
+
+		__m128i lo = round, hi = round;
+		const __m128i* vs[5] = { &v0, &v1, &v2, &v3, &v4 };
+		const __m128i* cs[5] = { &c2, &c1, &c0, &c1, &c2 };
+		for (int k = 0; k < 5; k++) {
+			__m128i pl = _mm_mullo_epi16(*vs[k], *cs[k]);
+			__m128i ph = _mm_mulhi_epu16(*vs[k], *cs[k]);
+			lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(pl, ph));
+			hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(pl, ph));
+		}
+		__m128i out = _mm_packs_epi32(_mm_srli_epi32(lo, 16), _mm_srli_epi32(hi, 16));
+		_mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(out, out));
+	}
+#endif
+
+	for (; x < width; x++) {
+		unsigned sum = src[x + 2] * GAUSS_0 + (src[x + 1] + src[x + 3]) * GAUSS_1 +
+			(src[x] + src[x + 4]) * GAUSS_2;
+		dst[x] = (uchar)((sum + (1 << 15)) >> 16);
+	}
+}
+
+void BgrToGrayBlur(const Mat& bgr, Mat& gray)
+{
+	CV_Assert(bgr.type() == CV_8UC3);
+
+	int width = bgr.cols;
+	int height = bgr.rows;
+	int padded = width + 2 * PAD;
+	gray.create(height, width, CV_8UC1);
+
+	// Five padded gray rows and one row of vertical sums per thread
+	static thread_local vector<uchar> ring;
+	static thread_local vector<ushort> sums;
+	ring.resize(5 * padded);
+	sums.resize(padded);
+
+	const CpuKernels& k = GetCpuKernels();
+	int converted = 0;
+	for (int y = 0; y < height; y++) {
+		int need = min(y + PAD, height - 1);
+		for (; converted <= need; converted++)
+			gray_row(k, bgr.ptr<uchar>(converted), &ring[(converted % 5) * padded], width);
+
+		const uchar* rows[5];
+		for (int i = 0; i < 5; i++)
+			rows[i] = &ring[(reflect101(y + i - PAD, height) % 5) * padded];
+
+		vert_row(rows[0], rows[1], rows[2], rows[3], rows[4], &sums[0], padded);
+		horiz_row(&sums[0], gray.ptr<uchar>(y), width);
+	}
+}
+
+int VerifyGrayBlur(const Mat& bgr, const Mat& gray)
+{
+	Mat ref;
+	cvtColor(bgr, ref, CV_BGR2GRAY);
+	GaussianBlur(ref, ref, Size(5, 5), 1.5);
+
+	Mat diff;
+	absdiff(ref, gray, diff);
+	double max_diff = 0;
+	minMaxLoc(diff, NULL, &max_diff);
+	return (int)max_diff;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef GRAY_BLUR_H
+#define GRAY_BLUR_H
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+
+// Fused cvtColor(CV_BGR2GRAY) + GaussianBlur(Size(5, 5), 1.5) for 8-bit
+// BGR input. Source rows are converted into a five row ring buffer and
+// each output row is produced as soon as its neighbourhood is available,
+// so the source is read once and the intermediates stay in cache. The
+// fixed point arithmetic follows OpenCV's bit-exact 8-bit paths, and the
+// border is BORDER_REFLECT_101 within the given (ROI) image.
+void BgrToGrayBlur(const Mat& bgr, Mat& gray);
+
+// Runs the OpenCV cvtColor + GaussianBlur chain on the same input and
+// returns the largest absolute difference to the fused result.
+int VerifyGrayBlur(const Mat& bgr, const Mat& gray);
+
+#endif // GRAY_BLUR_H
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <opencv2/core.hpp>
+#include <iostream>
+
+#include "cpu_kernels.h"
+#include "gray_blur.h"
+
+using namespace cv;
+using namespace std;
+
+// Checks the fused gray + blur kernel against cvtColor + GaussianBlur on
+// random images of awkward sizes, for the kernels picked by LDWS_KERNELS.
+// The fixed point paths should agree exactly; up to 1 is allowed like
+// with --verify-kernels, as OpenCV has changed its rounding before.
+int main()
+{
+	static const Size sizes[] = {
+		Size(1, 1), Size(1, 7), Size(7, 1), Size(2, 2), Size(3, 5), Size(15, 4),
+		Size(16, 16), Size(17, 9), Size(31, 33), Size(47, 3), Size(64, 48),
+		Size(333, 101), Size(640, 480), Size(1280, 200)
+	};
+	RNG rng(4);
+	int worst = 0, failed = 0;
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		// A ROI of a larger frame, so rows are not contiguous
+		Mat frame(sizes[i].height + 6, sizes[i].width + 10, CV_8UC3);
+		rng.fill(frame, RNG::UNIFORM, 0, 256);
+		Mat bgr(frame, Rect(Point(3, 2), sizes[i]));
+
+		Mat gray;
+		BgrToGrayBlur(bgr, gray);
+		int diff = VerifyGrayBlur(bgr, gray);
+		worst = max(worst, diff);
+		if (diff > 1) {
+			cerr << "gray blur " << sizes[i].width << "x" << sizes[i].height
+				<< " differs by " << diff << endl;
+			failed++;
+		}
+	}
+
+	cout << GetCpuKernels().name << " kernels: largest difference " << worst << endl;
+	return failed ? 1 : 0;
+}
@@ -29,12 +29,22 @@
 #include <vector>
 
 #include "config_store.h"
+#include "cpu_kernels.h"
 #include "lane_detector.h"
+#include "response_scan.h"
+#include "stage_stats.h"
 #include "util.h"
 
 using namespace cv;
 using namespace std;
 
+// Smoothing of the tracked line parameters
+static const double TRACKER_ALPHA = 0.2;
+// Responses a side needs near its predicted line on frames without
+// Hough, as a count and as a fraction of the scan rows
+static const int MIN_TRACK_POINTS = 3;
+static const double MIN_TRACK_SUPPORT = 0.15;
+
 CvPoint2D32f sub(CvPoint2D32f b, CvPoint2D32f a) { return cvPoint2D32f(b.x-a.x, b.y-a.y); }
 CvPoint2D32f mul(CvPoint2D32f b, CvPoint2D32f a) { return cvPoint2D32f(b.x*a.x, b.y*a.y); }
 CvPoint2D32f add(CvPoint2D32f b, CvPoint2D32f a) { return cvPoint2D32f(b.x+a.x, b.y+a.y); }
@@ -61,12 +71,12 @@ float dist2line(CvPoint2D32f line0, CvPoint2D32f line1, CvPoint2D32f pt){
 	return dist(sub(point_on_segment(line0, line1, pt), pt));
 }
 
-void LaneDetector::FindResponses(Mat edge, int startX, int endX, int y, std::vector<int>& list)
+void LaneDetector::FindResponses(const Mat& edge, int startX, int endX, int y, std::vector<int>& list)
 {
 	// scans for single response: /^\_
 
 	const int row = y * edge.cols * edge.channels();
-	unsigned char* ptr = edge.data;
+	const unsigned char* ptr = edge.data;
 
 	int step = (endX < startX) ? -1: 1;
 	int range = (endX > startX) ? endX-startX+1 : startX-endX+1;
@@ -93,13 +103,17 @@ void LaneDetector::FindResponses(Mat edge, int startX, int endX, int y, std::vec
 	}
 }
 
-void LaneDetector::ProcessSide(std::vector<Lane> lanes, Mat edge, bool right) {
+void LaneDetector::ProcessSide(const std::vector<Lane>& lanes, const Mat& edge, bool right) {
 
 	Status* side = right ? &laneR : &laneL;
+	vector<int>& votes = side_votes[right];
+	vector<int>& responses = side_responses[right];
 
 	// response search
-	int w = edge.cols;
-	int h = edge.rows;
+	// The edge map is only there for verification when it was scanned
+	// on the device
+	int w = scanner.EdgeSize().width;
+	int h = scanner.EdgeSize().height;
 	const int BEGINY = 0;
 	const int ENDY = h-1;
 	const int ENDX = right ? (w-cs->borderx) : cs->borderx;
@@ -107,15 +121,25 @@ void LaneDetector::ProcessSide(std::vector<Lane> lanes, Mat edge, bool right) {
 	int midy = h/2;
 
 	// show responses
-	int* votes = new int[lanes.size()];
-	for(int i=0; i<lanes.size(); i++) votes[i++] = 0;
-
-	for(int y=ENDY; y>=BEGINY; y-=cs->scan_step) {
-		std::vector<int> rsp;
-		FindResponses(edge, midx, ENDX, y, rsp);
+	votes.assign(lanes.size(), 0);
+
+	// responses of all scan rows were found up front in ProcessLanes
+	int row = 0;
+	for(int y=ENDY; y>=BEGINY; y-=scan_step, row++) {
+		// use first reponse (closest to screen center)
+		int response_x = right ? scanner.Right(row) : scanner.Left(row);
+
+		if (cs->verify_kernels && !edge.empty()) {
+			responses.clear();
+			FindResponses(edge, midx, ENDX, y, responses);
+			int expected = responses.size() > 0 ? responses[0] : -1;
+			if (expected != response_x)
+				cerr << "warning: response scan mismatch at y=" << y << " side "
+					<< (right ? "RIGHT" : "LEFT") << ": " << response_x << ", expected "
+					<< expected << endl;
+		}
 
-		if (rsp.size() > 0) {
-			int response_x = rsp[0]; // use first reponse (closest to screen center)
+		if (response_x >= 0) {
 
 			float dmin = 9999999;
 			float xmin = 9999999;
@@ -160,7 +184,7 @@ void LaneDetector::ProcessSide(std::vector<Lane> lanes, Mat edge, bool right) {
 	}
 
 	if (bestMatch != -1) {
-		Lane* best = &lanes[bestMatch];
+		const Lane* best = &lanes[bestMatch];
 		float k_diff = fabs(best->k - side->k.get());
 		float b_diff = fabs(best->b - side->b.get());
 
@@ -176,11 +200,13 @@ void LaneDetector::ProcessSide(std::vector<Lane> lanes, Mat edge, bool right) {
 			side->b.add(best->b);
 			side->reset = false;
 			side->lost = 0;
+			side->support = scanner.Rows() ? (float)votes[bestMatch] / scanner.Rows() : 0;
 		} else {
 			// can't update, lanes flicker periodically, start counter for partial reset!
 			side->lost++;
 			if (side->lost >= cs->max_lost_frames && !side->reset) {
 				side->reset = true;
+				side->support = 0;
 			}
 		}
 
@@ -191,17 +217,31 @@ void LaneDetector::ProcessSide(std::vector<Lane> lanes, Mat edge, bool right) {
 		if (side->lost >= cs->max_lost_frames && !side->reset) {
 			// do full reset when lost for more than N frames
 			side->reset = true;
+			side->support = 0;
 			side->k.clear();
 			side->b.clear();
 		}
 	}
+}
 
-	delete[] votes;
+void LaneDetector::ScanResponses(const Mat& edge, const ResponseScanner *scan)
+{
+	if (scan && scan->Step() == scan_step)
+		scanner = *scan;
+	else
+		scanner.Scan(edge, cs->bw_thresh, cs->borderx, scan_step);
 }
 
-void LaneDetector::ProcessLanes(vector<Vec4i> lines, Mat frame, Mat edge, Mat temp)
+void LaneDetector::ProcessLanes(const vector<Vec4i>& lines, const Mat& edge, int frame_width, int left_lines,
+		const ResponseScanner *scan)
 {
-	vector<Lane> left, right;
+	Predict();
+
+	StageTimer candidates_timer(STAGE_CANDIDATES);
+	vector<Lane>& left = left_lanes;
+	vector<Lane>& right = right_lanes;
+	left.clear();
+	right.clear();
 
 	for(int i = 0; i < lines.size(); i++ )
 	{
@@ -219,32 +259,64 @@ void LaneDetector::ProcessLanes(vector<Vec4i> lines, Mat frame, Mat edge, Mat te
 		float k = dy/(float)dx;
 		float b = pt1.y - k*pt1.x;
 
+		// Candidates from the lane Hough engine come sorted by side
+		if (left_lines >= 0) {
+			if (i < left_lines)
+				left.push_back(Lane(pt1, pt2, angle, k, b));
+			else
+				right.push_back(Lane(pt1, pt2, angle, k, b));
+			continue;
+		}
+
 		// Categorize lines per side based on frame midpoint
 		int midx = (pt1.x + pt2.x) / 2;
-		if (midx < frame.cols/2) {
+		if (midx < frame_width/2) {
 			left.push_back(Lane(pt1, pt2, angle, k, b));
-		} else if (midx > frame.cols/2) {
+		} else if (midx > frame_width/2) {
 			right.push_back(Lane(pt1, pt2, angle, k, b));
 		}
 	}
 
+	// Find responses of every scan row for both sides
+	ScanResponses(edge, scan);
+
+	candidates_timer.Stop();
+
+	// Process left and right sides, they share nothing but the scan and
+	// can run at the same time
+	if (cs->side_parallel) {
+		side_worker.Run([this, &right, &edge] {
+			StageTimer t(STAGE_SIDE_RIGHT);
+			ProcessSide(right, edge, true);
+		});
+	}
+	{
+		StageTimer t(STAGE_SIDE_LEFT);
+		ProcessSide(left, edge, false);
+	}
+	if (cs->side_parallel) {
+		side_worker.Wait();
+	} else {
+		StageTimer t(STAGE_SIDE_RIGHT);
+		ProcessSide(right, edge, true);
+	}
+}
+
+void LaneDetector::DrawLanes(Mat& frame)
+{
 	// Draw candidate lines
 	if (cs->intermediate_display) {
-		for	(int i=0; i<right.size(); i++) {
-			line(frame, right[i].p0 + roi, right[i].p1 + roi, CV_RGB(0, 0, 255), 2);
+		for	(int i=0; i<right_lanes.size(); i++) {
+			line(frame, right_lanes[i].p0 + roi, right_lanes[i].p1 + roi, CV_RGB(0, 0, 255), 2);
 		}
 
-		for	(int i=0; i<left.size(); i++) {
-			line(frame, left[i].p0 + roi, left[i].p1 + roi, CV_RGB(255, 0, 0), 2);
+		for	(int i=0; i<left_lanes.size(); i++) {
+			line(frame, left_lanes[i].p0 + roi, left_lanes[i].p1 + roi, CV_RGB(255, 0, 0), 2);
 		}
 	}
 
-	// Process left and right sides
-	ProcessSide(left, edge, false);
-	ProcessSide(right, edge, true);
-
 	// Draw lane guides
-	temp.setTo(0);
+	StageTimer t(STAGE_OVERLAY);
 	Point lane_pts[4];
 
 	int x = frame.cols * 0.55f;
@@ -257,13 +329,163 @@ void LaneDetector::ProcessLanes(vector<Vec4i> lines, Mat frame, Mat edge, Mat te
 	lane_pts[2] = Point(x, laneL.k.get()*x + laneL.b.get()) + roi;
 	lane_pts[3] = Point(x2, laneL.k.get() * x2 + laneL.b.get()) + roi;
 
-	fillConvexPoly(temp, lane_pts, 4, CV_RGB(0, 0, 255));
-	addWeighted(temp, 0.5, frame, 0.9, 0, frame);
+	// Only the bounding box of the lane polygon is blended, clipped to
+	// the frame before taking sizes so wild lines cannot overflow
+	int x0 = frame.cols, y0 = frame.rows, x1 = 0, y1 = 0;
+	for (int i = 0; i < 4; i++) {
+		x0 = min(x0, lane_pts[i].x);
+		y0 = min(y0, lane_pts[i].y);
+		x1 = max(x1, lane_pts[i].x + 1);
+		y1 = max(y1, lane_pts[i].y + 1);
+	}
+	x0 = max(x0, 0);
+	y0 = max(y0, 0);
+	x1 = min(x1, frame.cols);
+	y1 = min(y1, frame.rows);
+	if (x1 <= x0 || y1 <= y0)
+		return;
+	Rect box(x0, y0, x1 - x0, y1 - y0);
+	for (int i = 0; i < 4; i++)
+		lane_pts[i] -= box.tl();
+
+	// The scratch mask is frame sized and used from the top left, so
+	// the box moving around never reallocates
+	overlay_mask.create(frame.size(), CV_8UC1);
+	Mat mask(overlay_mask, Rect(Point(0, 0), box.size()));
+	mask.setTo(0);
+	fillConvexPoly(mask, lane_pts, 4, Scalar(255));
+
+	// Tint the polygon in place one span of the mask at a time, pixels
+	// outside it keep their captured value
+	const CpuKernels& k = GetCpuKernels();
+	Mat dst = frame(box);
+	for (int y = 0; y < box.height; y++) {
+		const uchar *m = mask.ptr<uchar>(y);
+		uchar *p = dst.ptr<uchar>(y);
+		int x = 0;
+		while ((x = k.first_above(m, x, box.width, 0)) >= 0) {
+			int end = x + 1;
+			while (end < box.width && m[end])
+				end++;
+			k.tint(p + 3 * x, 3 * (end - x), tint_pattern);
+			x = end;
+		}
+	}
+}
+
+bool LaneDetector::TrackSide(bool right, int h)
+{
+	Status* side = right ? &laneR : &laneL;
+	float k = side->k.get();
+	float b = side->b.get();
+	if (side->reset || !(fabs(k) > 0.05f))
+		return false;
+
+	// Least squares fit of x = p*y + q to the responses next to the
+	// predicted line; lanes are steep, so x over y is well conditioned
+	double n = 0, sy = 0, sx = 0, syy = 0, sxy = 0;
+	int rows = scanner.Rows();
+	int row = 0;
+	for (int y = h - 1; row < rows; y -= scan_step, row++) {
+		int x = right ? scanner.Right(row) : scanner.Left(row);
+		if (x < 0 || fabs(x - (y - b) / k) > cs->max_response_dist)
+			continue;
+		n++;
+		sy += y;
+		sx += x;
+		syy += (double)y * y;
+		sxy += (double)x * y;
+	}
+
+	double det = n * syy - sy * sy;
+	if (n < max((double)MIN_TRACK_POINTS, rows * MIN_TRACK_SUPPORT) || det <= 0)
+		return false;
+	double p = (n * sxy - sx * sy) / det;
+	double q = (sx - p * sy) / n;
+	if (fabs(p) < 1e-6)
+		return false;
+
+	side->k.add(1 / p);
+	side->b.add(-q / p);
+	side->support = n / rows;
+	return true;
+}
+
+bool LaneDetector::TrackLanes(const Mat& edge, const ResponseScanner *scan)
+{
+	Predict();
+
+	StageTimer t(STAGE_TRACK);
+	left_lanes.clear();
+	right_lanes.clear();
+	ScanResponses(edge, scan);
+
+	bool ok = true;
+	for (int s = 0; s < 2; s++) {
+		Status* side = s ? &laneR : &laneL;
+		if (TrackSide(s == 1, scanner.EdgeSize().height)) {
+			side->lost = 0;
+			continue;
+		}
+
+		// Unsupported sides are lost like in ProcessSide, and a lost side
+		// makes the next frames fully detected again
+		ok = false;
+		side->lost++;
+		if (side->lost >= cs->max_lost_frames && !side->reset) {
+			side->reset = true;
+			side->support = 0;
+			side->k.clear();
+			side->b.clear();
+		}
+	}
+
+	return ok;
+}
+
+void LaneDetector::Predict()
+{
+	laneL.k.predict();
+	laneL.b.predict();
+	laneR.k.predict();
+	laneR.b.predict();
+}
+
+LaneDetector::LaneState LaneDetector::GetLaneState(bool right) const
+{
+	const Status *side = right ? &laneR : &laneL;
+	LaneState state;
+	state.k = side->k.get();
+	state.b = side->b.get();
+	state.reset = side->reset;
+	state.lost = side->lost;
+	state.support = side->support;
+	return state;
+}
+
+LaneDetector::LaneDetector(ConfigStore *cs)
+{
+	this->cs = cs;
+	Init();
 }
 
-LaneDetector::LaneDetector()
+void LaneDetector::Init()
 {
-	cs = ConfigStore::GetInstance();
 	roi = Point(cs->roi.x, cs->roi.y);
+	scan_step = cs->scan_step;
+
+	// About 0.5 * tint + 0.9 * frame in 7 bit fixed point, see
+	// CpuKernels::tint
+	Scalar tint = CV_RGB(0, 0, 255);
+	for (int i = 0; i < TINT_PATTERN; i++)
+		tint_pattern[i] = (uint16_t)(tint[i % 3] * 64 + 64);
+
+	// Lines only move predictably enough to skip detection with a rate
+	// term, detecting every frame keeps the plain moving average
+	double beta = cs->keyframe_interval > 0 ? cs->tracker_beta : 0;
+	laneL.k.set_gains(TRACKER_ALPHA, beta);
+	laneL.b.set_gains(TRACKER_ALPHA, beta);
+	laneR.k.set_gains(TRACKER_ALPHA, beta);
+	laneR.b.set_gains(TRACKER_ALPHA, beta);
 }
 
@@ -21,6 +21,9 @@
 #include <vector>
 
 #include "config_store.h"
+#include "cpu_kernels.h"
+#include "response_scan.h"
+#include "side_worker.h"
 #include "util.h"
 
 using namespace cv;
@@ -29,12 +32,41 @@ using namespace std;
 class LaneDetector
 {
 	public:
-		LaneDetector();
-		void ProcessLanes(vector<Vec4i> lines, Mat frame, Mat edge, Mat temp);
+		LaneDetector(ConfigStore *cs);
+		// left_lines is the number of leading entries of lines that are
+		// known left side candidates, or -1 to split by position. A scan
+		// of the edge map made during detection is used instead of
+		// scanning edge again when its row step matches.
+		void ProcessLanes(const vector<Vec4i>& lines, const Mat& edge, int frame_width, int left_lines = -1,
+				const ResponseScanner *scan = NULL);
+		// Follows the tracked lanes on a frame without Hough candidates,
+		// using the scan responses close to the predicted lines. Returns
+		// false if a side did not have enough support.
+		bool TrackLanes(const Mat& edge, const ResponseScanner *scan = NULL);
+		// Renders the candidates of the last ProcessLanes call and the
+		// tracked lane area onto the frame
+		void DrawLanes(Mat& frame);
+		// Row step of the response search, scan_step unless changed
+		void SetScanStep(int step) { scan_step = step; }
+
+		// Current tracked line parameters of one side: y = kx + b
+		// in ROI coordinates
+		struct LaneState {
+			float k, b;
+			bool reset;
+			int lost;
+			// Fraction of the scan rows that supported the last
+			// accepted update, 0 after a reset
+			float support;
+		};
+		LaneState GetLaneState(bool right) const;
+		// Hough candidates of one side in the last ProcessLanes call
+		int Candidates(bool right) const { return right ? right_lanes.size() : left_lanes.size(); }
 
 	private:
 		ConfigStore *cs;
 		Point roi;
+		int scan_step;
 		struct Lane {
 			Lane(){}
 			Lane(Point a, Point b, float angle, float kl, float bl): p0(a),p1(b),angle(angle),
@@ -46,14 +78,27 @@ class LaneDetector
 			float angle, k, b;
 		};
 		struct Status {
-			Status():reset(true),lost(0){}
-			ExpMovingAverage k, b;
+			Status():reset(true),lost(0),support(0){}
+			AlphaBetaFilter k, b;
 			bool reset;
 			int lost;
+			float support;
 		};
 		Status laneR, laneL;
-		void FindResponses(Mat edge, int startX, int endX, int y, vector<int>& list);
-		void ProcessSide(vector<Lane> lanes, Mat edge, bool right);
+		void Init();
+		void Predict();
+		bool TrackSide(bool right, int h);
+		ResponseScanner scanner;
+		// Per frame buffers, kept so the steady state does not allocate
+		vector<Lane> left_lanes, right_lanes;
+		// Indexed by side, the sides may be processed at the same time
+		vector<int> side_votes[2], side_responses[2];
+		SideWorker side_worker;
+		Mat overlay_mask;
+		uint16_t tint_pattern[TINT_PATTERN];
+		void ScanResponses(const Mat& edge, const ResponseScanner *scan);
+		void FindResponses(const Mat& edge, int startX, int endX, int y, vector<int>& list);
+		void ProcessSide(const vector<Lane>& lanes, const Mat& edge, bool right);
 };
 
 #endif // LANE_DETECTOR_H
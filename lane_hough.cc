@@ -0,0 +1,246 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "config_store.h"
+#include "cpu_kernels.h"
+#include "edge_runs.h"
+#include "lane_hough.h"
+
+using namespace cv;
+using namespace std;
+
+// Strongest accumulator peaks traced per side
+static const int MAX_PEAKS = 16;
+
+void LaneHough::Prepare(Side& side, int theta_begin, int theta_end, Size size)
+{
+	int n = max(theta_end - theta_begin, 0);
+	side.theta_begin = theta_begin;
+	side.num_theta = n;
+
+	// Tables are padded to a multiple of 16 so no variant of the rho
+	// kernel needs a scalar tail
+	int padded = (n + 15) & ~15;
+	side.cos_tab.assign(padded, 0.f);
+	side.sin_tab.assign(padded, 0.f);
+	for (int t = 0; t < n; t++) {
+		double a = (theta_begin + t) * CV_PI / 180;
+		side.cos_tab[t] = (float)cos(a);
+		side.sin_tab[t] = (float)sin(a);
+	}
+
+	// Left lines have rho in [0, w + h], right lines in [-w, h]
+	side.rho_offset = (theta_begin < 90) ? 1 : size.width + 1;
+	side.acc.assign(n * num_rho, 0);
+}
+
+void LaneHough::Vote(Side& side, const vector<Point>& points)
+{
+	int n = side.num_theta;
+	int padded = side.cos_tab.size();
+	if (n == 0)
+		return;
+
+	uint16_t *acc = &side.acc[0];
+	const float *ct = &side.cos_tab[0];
+	const float *st = &side.sin_tab[0];
+	rho_idx.resize(padded);
+	int *ri = &rho_idx[0];
+	const CpuKernels& k = GetCpuKernels();
+
+	for (size_t i = 0; i < points.size(); i++) {
+		// rho for all angles with the vector kernel, the increments are
+		// a scatter and stay scalar
+		k.rho_bins(points[i].x, points[i].y, ct, st, side.rho_offset, padded, ri);
+		for (int t = 0; t < n; t++)
+			acc[t * num_rho + ri[t]]++;
+	}
+}
+
+void LaneHough::FindPeaks(const Side& side, vector<Peak>& peaks)
+{
+	peaks.clear();
+	int n = side.num_theta;
+	if (n == 0)
+		return;
+	const uint16_t *acc = &side.acc[0];
+
+	for (int t = 0; t < n; t++) {
+		for (int r = 1; r < num_rho - 1; r++) {
+			int v = acc[t * num_rho + r];
+			if (v < cs->hough_thresh)
+				continue;
+
+			// Local maximum over the 3x3 neighbourhood, ties go to the
+			// first cell in scan order
+			bool peak = v > acc[t * num_rho + r - 1] && v >= acc[t * num_rho + r + 1];
+			if (peak && t > 0)
+				peak = v > acc[(t - 1) * num_rho + r - 1] && v > acc[(t - 1) * num_rho + r] &&
+					v > acc[(t - 1) * num_rho + r + 1];
+			if (peak && t + 1 < n)
+				peak = v >= acc[(t + 1) * num_rho + r - 1] && v >= acc[(t + 1) * num_rho + r] &&
+					v >= acc[(t + 1) * num_rho + r + 1];
+			if (!peak)
+				continue;
+
+			Peak p;
+			p.votes = v;
+			p.theta = t;
+			p.rho = r - side.rho_offset;
+			peaks.push_back(p);
+		}
+	}
+
+	sort(peaks.begin(), peaks.end());
+	if (peaks.size() > (size_t)MAX_PEAKS)
+		peaks.resize(MAX_PEAKS);
+}
+
+void LaneHough::TraceSegments(const Mat& edge, float theta, float rho, vector<Vec4i>& lines)
+{
+	float c = cosf(theta);
+	float s = sinf(theta);
+
+	// Walk along the axis the line is steeper in, so every step moves
+	// at least one pixel along the line
+	bool by_y = fabs(c) > fabs(s);
+	int n = by_y ? edge.rows : edge.cols;
+
+	bool in_segment = false;
+	int gap = 0;
+	Point first, last;
+
+	for (int i = 0; i <= n; i++) {
+		bool hit = false;
+		Point pt;
+		if (i < n) {
+			if (by_y)
+				pt = Point((int)lrintf((rho - i * s) / c), i);
+			else
+				pt = Point(i, (int)lrintf((rho - i * c) / s));
+
+			// Accept the pixel or either neighbour across the line, the
+			// accumulator bins are a pixel wide
+			if (pt.x >= 0 && pt.x < edge.cols && pt.y >= 0 && pt.y < edge.rows) {
+				const uchar *row = edge.ptr<uchar>(pt.y);
+				hit = row[pt.x] != 0;
+				if (!hit && by_y)
+					hit = (pt.x > 0 && row[pt.x - 1]) || (pt.x + 1 < edge.cols && row[pt.x + 1]);
+				else if (!hit)
+					hit = (pt.y > 0 && edge.ptr<uchar>(pt.y - 1)[pt.x]) ||
+						(pt.y + 1 < edge.rows && edge.ptr<uchar>(pt.y + 1)[pt.x]);
+			}
+		}
+
+		if (hit) {
+			if (!in_segment)
+				first = pt;
+			last = pt;
+			in_segment = true;
+			gap = 0;
+			continue;
+		}
+
+		if (in_segment && (++gap > cs->hough_max_gap || i == n)) {
+			Point d = last - first;
+			if (d.x * d.x + d.y * d.y >= cs->hough_min_length * cs->hough_min_length)
+				lines.push_back(Vec4i(first.x, first.y, last.x, last.y));
+			in_segment = false;
+		}
+	}
+}
+
+int LaneHough::Detect(const Mat& edge, vector<Vec4i>& lines, const EdgeRuns *runs, Sides sides)
+{
+	CV_Assert(edge.type() == CV_8UC1);
+	lines.clear();
+	bool do_left = sides != RIGHT_SIDE;
+	bool do_right = sides != LEFT_SIDE;
+
+	if (edge.size() != size) {
+		size = edge.size();
+		num_rho = size.width + size.height + 3;
+		int reject = min(max(cs->line_reject_degrees, 0), 89);
+		Prepare(left, 0, 90 - reject + 1, size);
+		Prepare(right, 90 + reject, 180, size);
+	} else {
+		if (do_left)
+			fill(left.acc.begin(), left.acc.end(), 0);
+		if (do_right)
+			fill(right.acc.begin(), right.acc.end(), 0);
+	}
+
+	// Lanes meet near the horizontal center at the top of the ROI, so
+	// the two point sets overlap around the middle. A side that is not
+	// detected gets an empty range.
+	left_points.clear();
+	right_points.clear();
+	int left_end = do_left ? size.width * 6 / 10 : 0;
+	int right_begin = do_right ? size.width * 4 / 10 : size.width;
+	if (runs) {
+		CV_Assert(runs->EdgeSize() == size);
+		for (int y = 0; y < size.height; y++) {
+			for (const EdgeRuns::Run *r = runs->RowBegin(y); r != runs->RowEnd(y); r++) {
+				for (int x = r->begin; x < min(r->end, left_end); x++)
+					left_points.push_back(Point(x, y));
+				for (int x = max(r->begin, right_begin); x < r->end; x++)
+					right_points.push_back(Point(x, y));
+			}
+		}
+	} else {
+		for (int y = 0; y < size.height; y++) {
+			const uchar *row = edge.ptr<uchar>(y);
+			for (int x = 0; x < size.width; x++) {
+				if (!row[x])
+					continue;
+				if (x < left_end)
+					left_points.push_back(Point(x, y));
+				if (x >= right_begin)
+					right_points.push_back(Point(x, y));
+			}
+		}
+	}
+
+	if (do_left) {
+		Vote(left, left_points);
+		FindPeaks(left, peaks);
+		for (size_t i = 0; i < peaks.size(); i++)
+			TraceSegments(edge, (left.theta_begin + peaks[i].theta) * CV_PI / 180, peaks[i].rho, lines);
+	}
+	int left_count = lines.size();
+
+	if (do_right) {
+		Vote(right, right_points);
+		FindPeaks(right, peaks);
+		for (size_t i = 0; i < peaks.size(); i++)
+			TraceSegments(edge, (right.theta_begin + peaks[i].theta) * CV_PI / 180, peaks[i].rho, lines);
+	}
+
+	return left_count;
+}
+
+LaneHough::LaneHough(const ConfigStore *cs)
+{
+	this->cs = cs;
+	size = Size(0, 0);
+	num_rho = 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef LANE_HOUGH_H
+#define LANE_HOUGH_H
+
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "config_store.h"
+#include "edge_runs.h"
+
+using namespace cv;
+using namespace std;
+
+// Hough transform restricted to the angles LaneDetector keeps. Lines in
+// normal form x*cos(t) + y*sin(t) = r with t in [0, 90 - reject] rise to
+// the right and are left lane candidates, t in [90 + reject, 180) are
+// right lane candidates; everything in between is never voted for.
+// Segments are traced along the accumulator peaks with the usual
+// hough_min_length / hough_max_gap rules.
+class LaneHough
+{
+	public:
+		enum Sides { BOTH_SIDES, LEFT_SIDE, RIGHT_SIDE };
+
+		LaneHough(const ConfigStore *cs);
+
+		// Appends the left candidates to lines first, followed by the
+		// right ones, and returns how many left candidates there are.
+		// The votes come from runs when given, which must describe edge.
+		// With LEFT_SIDE or RIGHT_SIDE only that side is voted for and
+		// traced, from the same points as with BOTH_SIDES.
+		int Detect(const Mat& edge, vector<Vec4i>& lines, const EdgeRuns *runs = NULL,
+				Sides sides = BOTH_SIDES);
+
+	private:
+		struct Side {
+			int theta_begin;            // first theta bin, in degrees
+			int num_theta;
+			vector<float> cos_tab, sin_tab;
+			vector<uint16_t> acc;       // [theta][rho], theta-major
+			int rho_offset;
+		};
+		struct Peak {
+			int votes, theta, rho;
+			bool operator<(const Peak& p) const { return votes > p.votes; }
+		};
+
+		void Prepare(Side& side, int theta_begin, int theta_end, Size size);
+		void Vote(Side& side, const vector<Point>& points);
+		void FindPeaks(const Side& side, vector<Peak>& peaks);
+		void TraceSegments(const Mat& edge, float theta, float rho, vector<Vec4i>& lines);
+
+		const ConfigStore *cs;
+		Size size;
+		int num_rho;
+		Side left, right;
+		vector<Point> left_points, right_points;
+		vector<int> rho_idx;
+		vector<Peak> peaks;
+};
+
+#endif // LANE_HOUGH_H
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef LANE_SNAPSHOT_H
+#define LANE_SNAPSHOT_H
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "lane_detector.h"
+
+// Lane tracking state after each frame, published by whoever runs
+// LaneDetector and read by the detection workers to predict where the
+// lanes are in the frames they work on. Frame N always gets the state
+// after frame N - lag, whatever the thread timing, so the detection
+// input and the tracked lanes are the same from run to run. With the
+// pipeline the lag covers the frames a worker can be ahead by; serial
+// callers use a lag of one.
+class LaneSnapshot
+{
+	public:
+		LaneSnapshot(int lag = 1) : lag(lag > 0 ? lag : 1), ring(this->lag) {
+			initial.reset = true;
+			initial.lost = 0;
+			initial.k = initial.b = 0;
+			initial.support = 0;
+			Reset();
+		}
+
+		// Starts over at frame 0, nothing published
+		void Reset() {
+			std::lock_guard<std::mutex> lock(mutex);
+			published = -1;
+			closed = false;
+		}
+
+		// State after frame index, frames are published in order
+		void Publish(long index, const LaneDetector::LaneState& l, const LaneDetector::LaneState& r) {
+			std::lock_guard<std::mutex> lock(mutex);
+			ring[index % lag].left = l;
+			ring[index % lag].right = r;
+			published = index;
+			cond.notify_all();
+		}
+
+		// Lanes to predict frame index from, false when Close() came
+		// before they were published
+		bool Get(long index, LaneDetector::LaneState& l, LaneDetector::LaneState& r) const {
+			long want = index - lag;
+			if (want < 0) {
+				l = r = initial;
+				return true;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			while (published < want && !closed)
+				cond.wait(lock);
+			if (published < want)
+				return false;
+			l = ring[want % lag].left;
+			r = ring[want % lag].right;
+			return true;
+		}
+
+		// Releases the readers when no more states will be published
+		void Close() {
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			cond.notify_all();
+		}
+
+	private:
+		struct Lanes {
+			LaneDetector::LaneState left, right;
+		};
+
+		const int lag;
+		mutable std::mutex mutex;
+		mutable std::condition_variable cond;
+		std::vector<Lanes> ring;    // indexed by frame % lag
+		LaneDetector::LaneState initial;
+		long published;
+		bool closed;
+};
+
+#endif // LANE_SNAPSHOT_H
@@ -0,0 +1,377 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "config_store.h"
+#include "departure.h"
+#include "frame.h"
+#include "frame_source.h"
+#include "lane_detector.h"
+#include "lane_snapshot.h"
+#include "ldws.h"
+#include "line_detector.h"
+#include "pipeline.h"
+#include "realtime.h"
+#include "stage_stats.h"
+#include "telemetry.h"
+#include "trace.h"
+
+using namespace cv;
+using namespace std;
+
+// Frames after which every pooled buffer has been through the pipeline
+// and steady state allocation counting starts
+static const long WARMUP_FRAMES = 100;
+
+// Everything behind LdwsDetector, so its header needs none of the
+// detection internals
+struct LdwsDetector::State {
+	State(const ConfigStore& config)
+		: cfg(config), line_detector(NULL), lane_detector(NULL), departures(&cfg),
+		source(NULL), latest(NULL), quality(config.frame_budget_ms * 1e-3), pipeline(NULL),
+		current(NULL), last_left_lines(-1), frame_tick(0), streamed(0), dropped(0), traced(-1) {}
+
+	LdwsLane ToLane(const LaneDetector::LaneState& state) const;
+	void Result(long index, int64 capture_tick, int num_events, const DepartureEvent *events,
+			LdwsResult& result) const;
+
+	ConfigStore cfg;
+	LaneSnapshot lanes;
+	LineDetector *line_detector;    // for Process, the stream has its own
+	LaneDetector *lane_detector;
+	DepartureMonitor departures;
+	Frame frame;                    // wraps the caller's buffers
+
+	FrameSource *source;
+	LatestFrameSource *latest;
+	QualityController quality;
+	Pipeline *pipeline;
+	Frame *current;                 // last frame out of the pipeline
+	vector<Vec4i> last_lines;
+	int last_left_lines;
+	TelemetryWriter telemetry;
+	TraceWriter trace;
+	int64 frame_tick;
+	long streamed;
+	uint64_t dropped;
+	long traced;                    // -1 without a trace
+};
+
+LdwsLane LdwsDetector::State::ToLane(const LaneDetector::LaneState& state) const
+{
+	// y - roi.y = k * (x - roi.x) + b
+	LdwsLane lane;
+	lane.k = state.k;
+	lane.b = state.b + cfg.roi.y - state.k * cfg.roi.x;
+	lane.tracked = !state.reset && state.lost == 0;
+	lane.confidence = 0;
+	if (!state.reset && cfg.max_lost_frames > 0)
+		lane.confidence = state.support * max(0.f, 1 - (float)state.lost / cfg.max_lost_frames);
+	return lane;
+}
+
+void LdwsDetector::State::Result(long index, int64 capture_tick, int num_events,
+		const DepartureEvent *events, LdwsResult& result) const
+{
+	result.left = ToLane(lane_detector->GetLaneState(false));
+	result.right = ToLane(lane_detector->GetLaneState(true));
+	result.frame = index;
+	result.capture_tick = capture_tick;
+	result.departures = num_events;
+	for (int i = 0; i < num_events; i++) {
+		result.departure[i].right = events[i].right;
+		result.departure[i].offset = events[i].offset;
+	}
+}
+
+bool LdwsDetector::Process(const LdwsFrame& in, LdwsResult& result)
+{
+	ConfigStore& cfg = state->cfg;
+	Frame& frame = state->frame;
+	if (!in.data || in.width <= 0 || in.height <= 0)
+		return false;
+
+	Rect roi = in.roi;
+	if (roi.area() <= 0)
+		roi = Rect(cfg.roi.x, cfg.roi.y, cfg.roi.w, cfg.roi.h);
+	if (roi.area() <= 0 || (roi & Rect(0, 0, in.width, in.height)) != roi)
+		return false;
+
+	// Lanes are tracked in ROI coordinates, a new ROI starts over
+	if (roi != Rect(cfg.roi.x, cfg.roi.y, cfg.roi.w, cfg.roi.h)) {
+		cfg.roi.x = roi.x;
+		cfg.roi.y = roi.y;
+		cfg.roi.w = roi.width;
+		cfg.roi.h = roi.height;
+		Reset();
+	}
+
+	// Header-only Mats over the caller's buffer; the detectors only read
+	// the input, so dropping const is safe
+	void *data = const_cast<uint8_t*>(in.data);
+	if (in.format == LDWS_FORMAT_BGR24) {
+		if (in.stride < (size_t)in.width * 3)
+			return false;
+		frame.image = Mat(in.height, in.width, CV_8UC3, data, in.stride);
+		frame.luma = Mat();
+		frame.image_ready = true;
+	} else {
+		if (in.stride < (size_t)in.width)
+			return false;
+		frame.luma = Mat(in.height, in.width, CV_8UC1, data, in.stride);
+		frame.image = Mat();
+		frame.image_ready = false;
+	}
+	frame.capture_tick = getTickCount();
+
+	// Streams detect on the pipeline workers, so this one is only made
+	// for callers of Process
+	if (!state->line_detector)
+		state->line_detector = new LineDetector(&cfg, &state->lanes);
+
+	LaneDetector *ld = state->lane_detector;
+	state->line_detector->Detect(&frame);
+	if (frame.verify_only)
+		ld->TrackLanes(frame.edge, frame.Scan());
+	else
+		ld->ProcessLanes(frame.lines, frame.edge, frame.Width(), frame.left_lines, frame.Scan());
+	state->lanes.Publish(frame.index, ld->GetLaneState(false), ld->GetLaneState(true));
+
+	DepartureEvent events[2];
+	int num_events = state->departures.Check(*ld, frame.Width(), frame.index, frame.capture_tick, events);
+	state->Result(frame.index, frame.capture_tick, num_events, events, result);
+	frame.index++;
+
+	// Nothing may keep pointing into the caller's buffer
+	frame.image = Mat();
+	frame.luma = Mat();
+	return true;
+}
+
+void LdwsDetector::Reset()
+{
+	delete state->line_detector;
+	delete state->lane_detector;
+	state->lane_detector = new LaneDetector(&state->cfg);
+	state->line_detector = NULL;
+	state->lanes.Reset();
+	state->departures = DepartureMonitor(&state->cfg);
+	state->frame.index = 0;
+}
+
+bool LdwsDetector::Open()
+{
+	Close();
+	ConfigStore& cfg = state->cfg;
+
+	state->source = FrameSource::Open(&cfg);
+	if (!state->source->IsOpened()) {
+		delete state->source;
+		state->source = NULL;
+		return false;
+	}
+
+	// Realtime mode always works on the newest frame
+	state->latest = NULL;
+	if (cfg.realtime)
+		state->source = state->latest = new LatestFrameSource(state->source, cfg.frame_budget_ms * 1e-3);
+	state->quality = QualityController(cfg.frame_budget_ms * 1e-3);
+
+	if (!cfg.telemetry_shm.empty() && !state->telemetry.IsOpen())
+		state->telemetry.Open(cfg.telemetry_shm);
+	// A trace that cannot be written does not stop the stream, the
+	// caller finds out through Tracing()
+	if (!cfg.record_trace.empty())
+		state->trace.Open(&cfg, cfg.record_trace, FrameSize().width);
+
+	// Decode and detection run as separate pipeline stages, lanes are
+	// tracked in Next()
+	state->pipeline = new Pipeline(&cfg, state->source, cfg.threads);
+	state->pipeline->Start();
+	state->frame_tick = getTickCount();
+	state->last_left_lines = -1;
+	state->last_lines.clear();
+	state->dropped = 0;
+	state->traced = -1;
+	return true;
+}
+
+bool LdwsDetector::Next(LdwsResult& result)
+{
+	LoopAllocScope allocs(THREAD_FRAME);
+	Pipeline *pipeline = state->pipeline;
+	if (!pipeline)
+		return false;
+	if (state->current) {
+		pipeline->Release(state->current);
+		state->current = NULL;
+	}
+
+	Frame *f = pipeline->Next();
+	if (!f)
+		return false;
+	state->current = f;
+
+	const ConfigStore& cfg = state->cfg;
+	LaneDetector& ld = *state->lane_detector;
+	StageStats *stats = StageStats::GetInstance();
+
+	// Frames that skipped Hough reuse the candidates of the one before
+	// them
+	const vector<Vec4i> *lines = &f->lines;
+	int left_lines = f->left_lines;
+	if (f->hough_skipped) {
+		lines = &state->last_lines;
+		left_lines = state->last_left_lines;
+	} else if (cfg.realtime && !f->verify_only) {
+		state->last_lines = f->lines;
+		state->last_left_lines = f->left_lines;
+	}
+
+	// Lane tracking state depends on frame order, so it runs here where
+	// frames arrive in capture order. Frames between keyframes only
+	// follow the tracked lanes.
+	int scan_step = f->quality >= QUALITY_COARSE_SCAN ? cfg.scan_step * 2 : cfg.scan_step;
+	ld.SetScanStep(scan_step);
+	if (f->verify_only)
+		ld.TrackLanes(f->edge, f->Scan());
+	else
+		ld.ProcessLanes(*lines, f->edge, f->Width(), left_lines, f->Scan());
+	pipeline->PublishLanes(f->index, ld);
+	if (state->trace.IsOpened())
+		state->trace.Write(*f, *lines, left_lines, scan_step, ld);
+
+	DepartureEvent events[2];
+	int num_events = state->departures.Check(ld, f->Width(), f->index, f->capture_tick, events);
+	state->Result(f->index, f->capture_tick, num_events, events, result);
+
+	// Frames are detected concurrently, so measure the rate at which
+	// they come out of the pipeline
+	int64 now = getTickCount();
+	stats->Record(STAGE_FRAME, (now - state->frame_tick) / getTickFrequency());
+	state->frame_tick = now;
+	if (++state->streamed == WARMUP_FRAMES)
+		stats->SetWarm();
+	state->telemetry.Update(f->index, ld);
+
+	// The lanes of this frame are known, adjust the work for the frames
+	// to come
+	if (cfg.realtime)
+		pipeline->SetQuality(state->quality.Update((now - f->capture_tick) / getTickFrequency(), f->quality));
+	return true;
+}
+
+bool LdwsDetector::Close()
+{
+	if (!state->pipeline)
+		return true;
+
+	if (state->current) {
+		state->pipeline->Release(state->current);
+		state->current = NULL;
+	}
+	state->pipeline->Finish();
+	delete state->pipeline;
+	state->pipeline = NULL;
+
+	state->dropped = state->latest ? state->latest->Dropped() : 0;
+	delete state->source;
+	state->source = NULL;
+	state->latest = NULL;
+
+	bool ok = true;
+	if (state->trace.IsOpened()) {
+		state->traced = state->trace.Frames();
+		ok = state->trace.Close();
+	}
+	return ok;
+}
+
+Mat& LdwsDetector::Image()
+{
+	CV_Assert(state->current);
+	return state->current->image;
+}
+
+const Mat& LdwsDetector::Edge() const
+{
+	CV_Assert(state->current);
+	return state->current->edge;
+}
+
+void LdwsDetector::DrawLanes(Mat& image)
+{
+	state->lane_detector->DrawLanes(image);
+}
+
+Size LdwsDetector::FrameSize() const
+{
+	return state->source ? state->source->GetSize() : Size();
+}
+
+string LdwsDetector::Codec() const
+{
+	return state->source ? state->source->GetCodec() : string();
+}
+
+uint64_t LdwsDetector::DroppedFrames() const
+{
+	return state->latest ? state->latest->Dropped() : state->dropped;
+}
+
+uint64_t LdwsDetector::DegradedFrames() const
+{
+	return state->quality.Degraded();
+}
+
+uint64_t LdwsDetector::MissedFrames() const
+{
+	return state->quality.Missed();
+}
+
+bool LdwsDetector::Tracing() const
+{
+	return state->trace.IsOpened();
+}
+
+long LdwsDetector::TracedFrames() const
+{
+	return state->trace.IsOpened() ? state->trace.Frames() : state->traced;
+}
+
+const ConfigStore& LdwsDetector::Config() const
+{
+	return state->cfg;
+}
+
+LdwsDetector::LdwsDetector(const ConfigStore& config)
+	: state(new State(config))
+{
+	Reset();
+}
+
+LdwsDetector::~LdwsDetector()
+{
+	Close();
+	delete state->line_detector;
+	delete state->lane_detector;
+	delete state;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef LDWS_H
+#define LDWS_H
+
+#include <opencv2/core.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "config_store.h"
+
+// Layout of a caller-owned frame. Detection only reads the luma, so for
+// the YUV formats data points at the Y plane and chroma is never read.
+enum LdwsFormat {
+	LDWS_FORMAT_GRAY8,
+	LDWS_FORMAT_I420,
+	LDWS_FORMAT_NV12,
+	LDWS_FORMAT_BGR24
+};
+
+struct LdwsFrame {
+	LdwsFrame():data(NULL),width(0),height(0),stride(0),format(LDWS_FORMAT_GRAY8){}
+
+	const uint8_t *data;    // first row of the (luma) plane
+	int width, height;
+	size_t stride;          // bytes per row
+	LdwsFormat format;
+	cv::Rect roi;           // search region, empty for the configured one
+};
+
+// One tracked lane marking as y = kx + b in frame coordinates
+struct LdwsLane {
+	float k, b;
+	bool tracked;           // false while the side is searched anew
+	// 0..1, the share of scan rows that supported the lane, lowered
+	// for every frame the update was rejected
+	float confidence;
+};
+
+// The vehicle centerline coming within departure_margin of a marking
+struct LdwsDeparture {
+	bool right;             // side of the lane marking being crossed
+	float offset;           // centerline to marking distance in pixels,
+	                        // negative once the marking is crossed
+};
+
+struct LdwsResult {
+	LdwsLane left, right;
+	long frame;             // frames processed before this one
+	int64_t capture_tick;   // cv::getTickCount() when the frame came in
+	// Departures starting on this frame, at most one per side
+	int departures;
+	LdwsDeparture departure[2];
+};
+
+// Lane detection and tracking for embedding in another process. Every
+// detector works on its own copy of the configuration and keeps all of
+// its state, so detectors on different threads are independent; only
+// the stage statistics are shared.
+class LdwsDetector
+{
+	public:
+		LdwsDetector(const ConfigStore& config);
+		~LdwsDetector();
+
+		// Detects and tracks the lanes of the next caller-owned frame.
+		// The frame is wrapped, never copied, and must stay valid until
+		// this returns. Returns false, leaving the tracking state
+		// alone, if the frame or its ROI cannot be used.
+		bool Process(const LdwsFrame& frame, LdwsResult& result);
+		// Forgets the tracked lanes, e.g. after a cut in the input
+		void Reset();
+
+		// Streams the configured video_in instead: it is decoded on a
+		// thread of its own and detected on config.threads workers,
+		// with realtime, record_trace and telemetry_shm applied.
+		// Returns false if the input cannot be opened.
+		bool Open();
+		// Lanes of the next frame in capture order, false at the end
+		bool Next(LdwsResult& result);
+		// Stops the stream. Returns false if the trace could not be
+		// written.
+		bool Close();
+		// Whether the open stream records record_trace, false when the
+		// trace file could not be created
+		bool Tracing() const;
+
+		// The frame of the last Next(), valid until the next call. The
+		// BGR image is only made when the config is not headless. The
+		// edge map is empty when OpenCL scans it on the device, which
+		// is the case without intermediate_display and record_trace.
+		cv::Mat& Image();
+		const cv::Mat& Edge() const;
+		// Draws the tracked lanes and candidates over a full frame
+		void DrawLanes(cv::Mat& image);
+
+		cv::Size FrameSize() const;
+		std::string Codec() const;
+		// Realtime counts of the last stream, and the frames of its
+		// record_trace or -1 if it had none
+		uint64_t DroppedFrames() const;
+		uint64_t DegradedFrames() const;
+		uint64_t MissedFrames() const;
+		long TracedFrames() const;
+
+		const ConfigStore& Config() const;
+
+	private:
+		// Not copyable, the detectors point into the state
+		LdwsDetector(const LdwsDetector&);
+		LdwsDetector& operator=(const LdwsDetector&);
+
+		struct State;
+		State *state;
+};
+
+#endif // LDWS_H
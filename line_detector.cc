@@ -0,0 +1,610 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <iostream>
+#include <cmath>
+#include <vector>
+
+#include "config.h"
+#ifdef LDWS_CUDA
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudaarithm.hpp>
+#include <opencv2/cudafilters.hpp>
+#include <opencv2/cudaimgproc.hpp>
+#endif
+
+#include "config_store.h"
+#include "frame.h"
+#include "gray_blur.h"
+#include "lane_hough.h"
+#include "line_detector.h"
+#include "ocl_response_scan.h"
+#include "stage_stats.h"
+
+using namespace cv;
+using namespace std;
+
+// Horizontal strips per side when covering a predicted lane
+static const int BAND_STRIPS = 4;
+// Context kept around each band for Canny's gradient and hysteresis
+static const int BAND_PAD = 4;
+// Deepest pyramid level lines are detected on
+static const int MAX_PYRAMID_LEVELS = 3;
+
+void LineDetector::Detect(Frame *f)
+{
+	// Frames are recycled, only the paths that set these may leave them on
+	f->verify_only = false;
+	f->hough_skipped = false;
+	f->scanned = false;
+
+#ifdef LDWS_CUDA
+	if (cs->cuda_enabled) {
+		// CUDA implementation
+		if (!f->luma.empty()) {
+			// YUV input, only the luma of the ROI goes to the device
+			StageTimer t(STAGE_UPLOAD);
+			gpu_gray.upload(Mat(f->luma, roi_rect));
+		} else {
+			{
+				StageTimer t(STAGE_UPLOAD);
+				gpu_frame.upload(f->image);
+			}
+
+			// Set ROI to reduce workload
+			cv::cuda::GpuMat gpu_roi(gpu_frame, roi_rect);
+
+			// Convert to grayscale
+			StageTimer t(STAGE_GRAY);
+			cv::cuda::cvtColor(gpu_roi, gpu_gray, CV_BGR2GRAY);
+		}
+
+		// Blur
+		{
+			StageTimer t(STAGE_BLUR);
+			blur->apply(gpu_gray, gpu_gray);
+		}
+
+		// Canny edge detection
+		{
+			StageTimer t(STAGE_CANNY);
+			canny->detect(gpu_gray, gpu_edge);
+		}
+
+		// Probabilistic Hough line detection
+		if (!SkipHough(f)) {
+			StageTimer t(STAGE_HOUGH);
+			hough->detect(gpu_edge, gpu_lines);
+			f->lines.resize(gpu_lines.cols);
+			f->left_lines = -1;
+			if (gpu_lines.cols > 0) {
+				// Header only, the lines are downloaded into f->lines
+				Mat temp(1, gpu_lines.cols, CV_32SC4, &f->lines[0]);
+				gpu_lines.download(temp);
+			}
+		}
+
+		{
+			StageTimer t(STAGE_UPLOAD);
+			gpu_edge.download(f->edge);
+		}
+		ScanEdges(f);
+	} else
+#endif
+	if (!cs->opencl_enabled && (cs->fused_gray_blur || !f->luma.empty())) {
+		if (!f->luma.empty()) {
+			// CPU implementation for YUV input, the ROI of the mapped Y
+			// plane is blurred directly, with borders taken from the ROI
+			// only like the separate gray image of the BGR path
+			StageTimer t(STAGE_BLUR);
+			GaussianBlur(Mat(f->luma, roi_rect), gray, Size(5, 5), 1.5, 0,
+					BORDER_DEFAULT | BORDER_ISOLATED);
+		} else {
+			// CPU implementation, grayscale and blur in one pass straight
+			// from the ROI of the captured frame
+			StageTimer t(STAGE_BLUR);
+			BgrToGrayBlur(Mat(f->image, roi_rect), gray);
+		}
+
+		if (cs->verify_kernels && f->luma.empty()) {
+			Mat roi(f->image, roi_rect);
+			int diff = VerifyGrayBlur(roi, gray);
+			if (diff > 1)
+				cerr << "warning: fused gray/blur differs by " << diff << " on frame " << f->index << endl;
+		}
+
+		// Canny edge detection, limited to the predicted lane bands
+		// while both lanes are tracked
+		bool banded = PredictBands(f->index, bands);
+		if (banded && !IsKeyframe(f)) {
+			StageTimer t(STAGE_CANNY);
+			BandCanny(gray, bands, band_edge, f->edge);
+			VerifyOnly(f);
+			return;
+		}
+		if (!banded && f->quality >= QUALITY_HALF_SCALE) {
+			HalfScaleLines(gray, small, small_edge, f);
+			return;
+		}
+		// Otherwise the bands can come from a pyramid level
+		if (!banded && cs->pyramid_levels > 0)
+			banded = CoarseBands(gray, pyramid, bands);
+		if (!banded && cs->side_parallel && cs->hough_engine != "birdseye") {
+			SideLines(f);
+			return;
+		}
+		{
+			StageTimer t(STAGE_CANNY);
+			if (banded)
+				BandCanny(gray, bands, band_edge, f->edge);
+			else
+				Canny(gray, f->edge, cs->canny_min_thresh, cs->canny_max_thresh);
+		}
+
+		// Hough line detection
+		StageTimer t(STAGE_HOUGH);
+		FindLines(f);
+	} else {
+		// TAPI implementation
+		if (!f->luma.empty()) {
+			// YUV input, the luma of the ROI is already grayscale
+			StageTimer t(STAGE_UPLOAD);
+			Mat(f->luma, roi_rect).copyTo(u_gray);
+		} else {
+			{
+				StageTimer t(STAGE_UPLOAD);
+				f->image.copyTo(u_frame);
+			}
+
+			// Set ROI to reduce workload
+			UMat u_roi(u_frame, roi_rect);
+
+			// Convert to grayscale
+			StageTimer t(STAGE_GRAY);
+			cvtColor(u_roi, u_gray, CV_BGR2GRAY);
+		}
+
+		// Blur
+		{
+			StageTimer t(STAGE_BLUR);
+			GaussianBlur(u_gray, u_gray, Size(5, 5), 1.5);
+		}
+
+		// Canny edge detection, limited to the predicted lane bands
+		// while both lanes are tracked. The bands are small, so they are
+		// gathered on the host and Hough runs there as well.
+		bool banded = PredictBands(f->index, bands);
+		if (banded && !IsKeyframe(f)) {
+			StageTimer t(STAGE_CANNY);
+			BandCanny(u_gray, bands, u_band_edge, f->edge);
+			VerifyOnly(f);
+			return;
+		}
+		if (!banded && f->quality >= QUALITY_HALF_SCALE) {
+			HalfScaleLines(u_gray, u_small, u_small_edge, f);
+			return;
+		}
+		if (!banded && cs->pyramid_levels > 0)
+			banded = CoarseBands(u_gray, u_pyramid, bands);
+		if (banded) {
+			{
+				StageTimer t(STAGE_CANNY);
+				BandCanny(u_gray, bands, u_band_edge, f->edge);
+			}
+
+			StageTimer t(STAGE_HOUGH);
+			FindLines(f);
+			return;
+		}
+
+		{
+			StageTimer t(STAGE_CANNY);
+			Canny(u_gray, u_edge, cs->canny_min_thresh, cs->canny_max_thresh);
+		}
+
+		if (cs->hough_engine != "opencv") {
+			// The lane and top view engines run on the host
+			{
+				StageTimer t(STAGE_UPLOAD);
+				u_edge.copyTo(f->edge);
+			}
+			StageTimer t(STAGE_HOUGH);
+			FindLines(f);
+			return;
+		}
+
+		// Probabilistic Hough line detection
+		if (!SkipHough(f)) {
+			StageTimer t(STAGE_HOUGH);
+			HoughLinesP(u_edge, f->lines, rho, theta, cs->hough_thresh, cs->hough_min_length, cs->hough_max_gap);
+			f->left_lines = -1;
+		}
+
+		// Only the response scan leaves the device, unless the edge map
+		// itself is shown or recorded
+		if (!cs->intermediate_display && cs->record_trace.empty() && DeviceScan(f))
+			return;
+
+		// The frame outlives this call, so it gets its own copy of the
+		// edge map rather than a reference into u_edge
+		{
+			StageTimer t(STAGE_UPLOAD);
+			u_edge.copyTo(f->edge);
+		}
+		ScanEdges(f);
+	}
+}
+
+int LineDetector::ScanStep(const Frame *f) const
+{
+	// The row step LaneDetector will scan this frame with
+	return f->quality >= QUALITY_COARSE_SCAN ? cs->scan_step * 2 : cs->scan_step;
+}
+
+void LineDetector::ScanEdges(Frame *f)
+{
+	if (!cs->edge_runs)
+		return;
+
+	// Part of edge extraction, everything after works on the runs
+	StageTimer t(STAGE_CANNY);
+	f->runs.Build(f->edge);
+	f->scan.Scan(f->runs, cs->bw_thresh, cs->borderx, ScanStep(f));
+	f->scanned = true;
+}
+
+bool LineDetector::DeviceScan(Frame *f)
+{
+	int step = ScanStep(f);
+	{
+		StageTimer t(STAGE_UPLOAD);
+		if (!ocl_scanner.Scan(u_edge, cs->bw_thresh, cs->borderx, step, f->scan))
+			return false;
+	}
+	f->scanned = true;
+
+	// The edge map stays on the device. The pooled frame would still
+	// hold the one of an earlier frame, so it is left empty instead.
+	if (!cs->verify_kernels) {
+		f->edge.release();
+		return true;
+	}
+
+	u_edge.copyTo(f->edge);
+	ResponseScanner host;
+	host.Scan(f->edge, cs->bw_thresh, cs->borderx, step);
+	for (int i = 0; i < host.Rows(); i++)
+		if (host.Left(i) != f->scan.Left(i) || host.Right(i) != f->scan.Right(i))
+			cerr << "warning: OpenCL response scan differs in row " << i << " on frame "
+				<< f->index << ": " << f->scan.Left(i) << "," << f->scan.Right(i)
+				<< ", expected " << host.Left(i) << "," << host.Right(i) << endl;
+	return true;
+}
+
+void LineDetector::SideLines(Frame *f)
+{
+	f->edge.create(gray.size(), CV_8UC1);
+
+	// The right half goes to the side worker, the left one is done here
+	side_worker.Run([this, f] { HalfEdges(f, true); });
+	HalfEdges(f, false);
+	side_worker.Wait();
+	ScanEdges(f);
+
+	if (SkipHough(f))
+		return;
+	side_worker.Run([this, f] { HalfLines(f, true); });
+	HalfLines(f, false);
+	side_worker.Wait();
+
+	f->lines.assign(side_lines[0].begin(), side_lines[0].end());
+	f->left_lines = f->lines.size();
+	f->lines.insert(f->lines.end(), side_lines[1].begin(), side_lines[1].end());
+}
+
+Rect LineDetector::HalfRect(bool right, Rect& core) const
+{
+	// Each half reaches side_overlap past the middle, so Canny has context
+	// at the seam and lines crossing it are found whole
+	int mid = gray.cols / 2;
+	int overlap = max(cs->side_overlap, 0);
+	Rect bounds(0, 0, gray.cols, gray.rows);
+	core = right ? Rect(mid, 0, gray.cols - mid, gray.rows) : Rect(0, 0, mid, gray.rows);
+	return Rect(core.x - overlap, 0, core.width + 2 * overlap, gray.rows) & bounds;
+}
+
+void LineDetector::HalfEdges(Frame *f, bool right)
+{
+	Rect core;
+	Rect outer = HalfRect(right, core);
+
+	StageTimer t(STAGE_CANNY);
+	Canny(Mat(gray, outer), side_edge[right], cs->canny_min_thresh, cs->canny_max_thresh);
+	// The halves write disjoint parts of the frame's edge map
+	Mat(side_edge[right], Rect(core.tl() - outer.tl(), core.size())).copyTo(Mat(f->edge, core));
+}
+
+void LineDetector::HalfLines(Frame *f, bool right)
+{
+	StageTimer t(STAGE_HOUGH);
+	vector<Vec4i>& lines = side_lines[right];
+
+	// The lane engine votes for one lane over the whole edge map, from
+	// the same points a serial Detect would use for that side
+	if (cs->hough_engine == "lane") {
+		(right ? right_hough : left_hough).Detect(f->edge, lines, cs->edge_runs ? &f->runs : NULL,
+				right ? LaneHough::RIGHT_SIDE : LaneHough::LEFT_SIDE);
+		return;
+	}
+
+	// Otherwise each half is searched on its own and a line belongs to
+	// the half its midpoint is in
+	Rect core;
+	Rect outer = HalfRect(right, core);
+	RunHough(side_edge[right], cs, right ? right_hough : left_hough, lines);
+	size_t n = 0;
+	for (size_t i = 0; i < lines.size(); i++) {
+		Vec4i l = lines[i];
+		l[0] += outer.x;
+		l[2] += outer.x;
+		int x = (l[0] + l[2]) / 2;
+		if (right ? x >= core.x : x < core.br().x)
+			lines[n++] = l;
+	}
+	lines.resize(n);
+}
+
+bool LineDetector::IsKeyframe(const Frame *f) const
+{
+	return cs->keyframe_interval <= 0 || f->index % cs->keyframe_interval == 0;
+}
+
+void LineDetector::VerifyOnly(Frame *f)
+{
+	ScanEdges(f);
+	f->lines.clear();
+	f->left_lines = -1;
+	f->verify_only = true;
+}
+
+bool LineDetector::SkipHough(Frame *f)
+{
+	f->hough_skipped = f->quality >= QUALITY_SKIP_HOUGH && (f->index & 1);
+	if (f->hough_skipped) {
+		f->lines.clear();
+		f->left_lines = -1;
+	}
+	return f->hough_skipped;
+}
+
+void LineDetector::FindLines(Frame *f)
+{
+	ScanEdges(f);
+	if (SkipHough(f))
+		return;
+
+	f->left_lines = RunHough(f->edge, cs, lane_hough, f->lines, cs->edge_runs ? &f->runs : NULL);
+}
+
+int LineDetector::RunHough(const Mat& edge, const ConfigStore *c, LaneHough& engine, vector<Vec4i>& lines,
+		const EdgeRuns *runs)
+{
+	if (c->hough_engine == "lane")
+		return engine.Detect(edge, lines, runs);
+	if (c->hough_engine == "birdseye")
+		return birdseye.Detect(edge, lines, runs);
+
+	HoughLinesP(edge, lines, rho, theta, c->hough_thresh, c->hough_min_length, c->hough_max_gap);
+	return -1;
+}
+
+bool LineDetector::PredictBands(long index, vector<Rect>& bands)
+{
+	bands.clear();
+	if (!cs->roi_narrowing || !lanes)
+		return false;
+
+	LaneDetector::LaneState state[2];
+	if (!lanes->Get(index, state[0], state[1]))
+		return false;
+
+	for (int s = 0; s < 2; s++) {
+		const LaneDetector::LaneState& lane = state[s];
+		// Only follow lanes that are locked, and never nearly horizontal
+		// ones which would cover the whole ROI anyway
+		if (lane.reset || lane.lost > 0 || !(fabs(lane.k) > 0.05f) || !std::isfinite(lane.b))
+			return false;
+	}
+
+	for (int s = 0; s < 2; s++)
+		AddLaneBands(state[s].k, state[s].b, cs->band_margin, bands);
+
+	return true;
+}
+
+void LineDetector::AddLaneBands(float k, float b, int margin, vector<Rect>& bands)
+{
+	Rect bounds(0, 0, roi_rect.width, roi_rect.height);
+	int strip_h = (roi_rect.height + BAND_STRIPS - 1) / BAND_STRIPS;
+
+	// Cover the line with a few boxes so the band stays thin
+	for (int y0 = 0; y0 < roi_rect.height; y0 += strip_h) {
+		int y1 = min(y0 + strip_h, roi_rect.height);
+		float xa = (y0 - b) / k;
+		float xb = (y1 - b) / k;
+		int x0 = (int)floorf(min(xa, xb)) - margin;
+		int x1 = (int)ceilf(max(xa, xb)) + margin;
+		Rect band = Rect(x0, y0, x1 - x0, y1 - y0) & bounds;
+		if (band.area() > 0)
+			bands.push_back(band);
+	}
+}
+
+template <typename M>
+bool LineDetector::CoarseBands(const M& gray, vector<M>& pyramid, vector<Rect>& bands)
+{
+	StageTimer t(STAGE_COARSE);
+	int levels = min(cs->pyramid_levels, MAX_PYRAMID_LEVELS);
+	int scale = 1 << levels;
+
+	pyramid.resize(levels);
+	const M *level = &gray;
+	for (int i = 0; i < levels; i++) {
+		pyrDown(*level, pyramid[i]);
+		level = &pyramid[i];
+	}
+
+	// The top level is small, so its edges always go to the host where
+	// either Hough engine can take them
+	Canny(*level, coarse_edge, cs->canny_min_thresh, cs->canny_max_thresh);
+	int left_lines = RunHough(coarse_edge, &coarse_cs, coarse_hough, coarse_lines);
+
+	// Keep the longest candidate of each side. Lines that rise to the
+	// right are left lanes, unless the lane engine has sorted them.
+	int best[2] = { -1, -1 };
+	int best_len[2] = { 0, 0 };
+	for (int i = 0; i < (int)coarse_lines.size(); i++) {
+		const Vec4i& l = coarse_lines[i];
+		int dx = l[2] - l[0];
+		int dy = l[3] - l[1];
+		if (fabs(atan2f(dy, dx) * 180 / CV_PI) < cs->line_reject_degrees)
+			continue;
+
+		int s;
+		if (left_lines >= 0)
+			s = (i < left_lines) ? 0 : 1;
+		else
+			s = ((dx > 0) == (dy < 0)) ? 0 : 1;
+
+		int len = dx * dx + dy * dy;
+		if (len > best_len[s]) {
+			best[s] = i;
+			best_len[s] = len;
+		}
+	}
+
+	// Bands leave the rest of the ROI without edges, so a side the
+	// coarse level missed could not be found at full resolution; search
+	// the whole ROI then
+	bands.clear();
+	if (best[0] < 0 || best[1] < 0)
+		return false;
+
+	// Refine at full resolution in a window around each, wide enough to
+	// cover the rounding of the coarse level too
+	for (int s = 0; s < 2; s++) {
+		const Vec4i& l = coarse_lines[best[s]];
+		float dx = (l[2] - l[0]) * scale;
+		float dy = (l[3] - l[1]) * scale;
+		if (dx == 0)
+			dx = 1;
+		float k = dy / dx;
+		float b = l[1] * scale - k * l[0] * scale;
+		size_t n = bands.size();
+		AddLaneBands(k, b, cs->band_margin + scale, bands);
+		if (bands.size() == n) {
+			bands.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+template <typename M>
+void LineDetector::BandCanny(const M& gray, const vector<Rect>& bands, M& scratch, Mat& edge)
+{
+	Rect bounds(0, 0, gray.cols, gray.rows);
+	edge.create(gray.size(), CV_8UC1);
+	edge.setTo(0);
+
+	// Every band is worked on in the top left corner of ROI sized scratch
+	// images, so band sizes changing from frame to frame never reallocate
+	scratch.create(gray.size(), CV_8UC1);
+	band_core.create(gray.size(), CV_8UC1);
+
+	for (size_t i = 0; i < bands.size(); i++) {
+		// Run Canny with some context around the band so its own border
+		// handling does not show up in the result, then keep the core
+		Rect outer = Rect(bands[i].x - BAND_PAD, bands[i].y - BAND_PAD,
+				bands[i].width + 2 * BAND_PAD, bands[i].height + 2 * BAND_PAD) & bounds;
+		M outer_edge(scratch, Rect(Point(0, 0), outer.size()));
+		Canny(M(gray, outer), outer_edge, cs->canny_min_thresh, cs->canny_max_thresh);
+		Mat core(band_core, Rect(Point(0, 0), bands[i].size()));
+		M(outer_edge, Rect(bands[i].tl() - outer.tl(), bands[i].size())).copyTo(core);
+
+		// Bands of the two sides can overlap
+		Mat dst = edge(bands[i]);
+		bitwise_or(dst, core, dst);
+	}
+}
+
+template <typename M>
+void LineDetector::HalfScaleLines(const M& gray, M& small, M& small_edge, Frame *f)
+{
+	{
+		StageTimer t(STAGE_CANNY);
+		pyrDown(gray, small);
+		Canny(small, small_edge, cs->canny_min_thresh, cs->canny_max_thresh);
+		// The response search still works on a full size edge map
+		resize(small_edge, f->edge, gray.size(), 0, 0, INTER_NEAREST);
+	}
+	ScanEdges(f);
+
+	if (SkipHough(f))
+		return;
+
+	// Both engines' thresholds are in pixels, so they are halved along
+	// with the image. Only the OpenCV engine is used here, the lane
+	// engine would rebuild its tables at every change of scale.
+	StageTimer t(STAGE_HOUGH);
+	HoughLinesP(small_edge, f->lines, rho, theta, max(cs->hough_thresh / 2, 1),
+			cs->hough_min_length / 2, cs->hough_max_gap / 2);
+	for (size_t i = 0; i < f->lines.size(); i++)
+		f->lines[i] *= 2;
+	f->left_lines = -1;
+}
+
+LineDetector::LineDetector(ConfigStore *cs, const LaneSnapshot *lanes)
+	: lane_hough(cs), birdseye(cs), coarse_cs(*cs), coarse_hough(&coarse_cs), left_hough(cs), right_hough(cs)
+{
+	this->cs = cs;
+	this->lanes = lanes;
+	// FIXME need to error check for valid roi
+	roi_rect = Rect(cs->roi.x, cs->roi.y, cs->roi.w, cs->roi.h);
+	rho = 1;
+	theta = CV_PI/180;
+
+	// Hough thresholds are in pixels of the level they run on
+	int levels = min(max(cs->pyramid_levels, 0), MAX_PYRAMID_LEVELS);
+	coarse_cs.hough_thresh = max(cs->hough_thresh >> levels, 1);
+	coarse_cs.hough_min_length = cs->hough_min_length >> levels;
+	coarse_cs.hough_max_gap = cs->hough_max_gap >> levels;
+	// The top view is calibrated for the full ROI, bands are found with
+	// the lane engine instead
+	if (coarse_cs.hough_engine == "birdseye")
+		coarse_cs.hough_engine = "lane";
+
+#ifdef LDWS_CUDA
+	if (cs->cuda_enabled) {
+		blur = cv::cuda::createGaussianFilter(CV_8UC1, CV_8UC1, Size(5, 5), 1.5);
+		canny = cv::cuda::createCannyEdgeDetector(cs->canny_min_thresh, cs->canny_max_thresh, 3, false);
+		hough = cv::cuda::createHoughSegmentDetector(rho, theta, cs->hough_min_length, cs->hough_max_gap);
+	}
+#endif
+}
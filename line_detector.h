@@ -0,0 +1,115 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef LINE_DETECTOR_H
+#define LINE_DETECTOR_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "config.h"
+#ifdef LDWS_CUDA
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudafilters.hpp>
+#include <opencv2/cudaimgproc.hpp>
+#endif
+
+#include "birdseye.h"
+#include "config_store.h"
+#include "frame.h"
+#include "lane_hough.h"
+#include "lane_snapshot.h"
+#include "ocl_response_scan.h"
+#include "side_worker.h"
+
+using namespace cv;
+using namespace std;
+
+// Runs the per-frame ROI / grayscale / blur / Canny / Hough chain.
+// A LineDetector keeps scratch buffers, its side worker thread and the
+// OpenCL scanner between frames, and reads the tracked lanes from the
+// shared LaneSnapshot for band narrowing. Use one per thread: several
+// LineDetectors sharing a snapshot can work on different frames at the
+// same time.
+class LineDetector
+{
+	public:
+		LineDetector(ConfigStore *cs, const LaneSnapshot *lanes = NULL);
+		void Detect(Frame *f);
+
+	private:
+		void FindLines(Frame *f);
+		// Clears the lines of frames the realtime mode skips Hough on
+		bool SkipHough(Frame *f);
+		// Scans u_edge for lane responses on the OpenCL device, so the
+		// edge map does not have to come back to the host. f->edge is
+		// left empty then, unless verify_kernels needs it.
+		bool DeviceScan(Frame *f);
+		int ScanStep(const Frame *f) const;
+		// Turns the final edge map into runs and scans them for lane
+		// responses, so the dense map is read once
+		void ScanEdges(Frame *f);
+		// Canny on the two halves of the ROI, then Hough per side, one of
+		// each on the side worker
+		void SideLines(Frame *f);
+		Rect HalfRect(bool right, Rect& core) const;
+		void HalfEdges(Frame *f, bool right);
+		void HalfLines(Frame *f, bool right);
+		// Between keyframes, frames with tracked lanes get no Hough and
+		// are only checked against the tracker
+		bool IsKeyframe(const Frame *f) const;
+		void VerifyOnly(Frame *f);
+		template <typename M> void HalfScaleLines(const M& gray, M& small, M& small_edge, Frame *f);
+		int RunHough(const Mat& edge, const ConfigStore *c, LaneHough& engine, vector<Vec4i>& lines,
+				const EdgeRuns *runs = NULL);
+		bool PredictBands(long index, vector<Rect>& bands);
+		void AddLaneBands(float k, float b, int margin, vector<Rect>& bands);
+		template <typename M> bool CoarseBands(const M& gray, vector<M>& pyramid, vector<Rect>& bands);
+		template <typename M> void BandCanny(const M& gray, const vector<Rect>& bands, M& scratch, Mat& edge);
+
+		ConfigStore *cs;
+		const LaneSnapshot *lanes;
+		Rect roi_rect;
+		double rho;
+		double theta;
+#ifdef LDWS_CUDA
+		cv::cuda::GpuMat gpu_frame, gpu_gray, gpu_edge, gpu_lines;
+#endif
+		UMat u_frame, u_gray, u_edge, u_band_edge, u_small, u_small_edge;
+		Mat gray, band_edge, band_core, small, small_edge, coarse_edge;
+		vector<Mat> pyramid;
+		vector<UMat> u_pyramid;
+		vector<Vec4i> coarse_lines;
+		vector<Rect> bands;
+		LaneHough lane_hough;
+		BirdsEye birdseye;
+		OclResponseScanner ocl_scanner;
+		// Configuration and engine for the top pyramid level
+		ConfigStore coarse_cs;
+		LaneHough coarse_hough;
+		// Per side state of SideLines
+		LaneHough left_hough, right_hough;
+		Mat side_edge[2];
+		vector<Vec4i> side_lines[2];
+		SideWorker side_worker;
+#ifdef LDWS_CUDA
+		cv::Ptr<cv::cuda::Filter> blur;
+		cv::Ptr<cv::cuda::CannyEdgeDetector> canny;
+		cv::Ptr<cv::cuda::HoughSegmentDetector> hough;
+#endif
+};
+
+#endif // LINE_DETECTOR_H
@@ -15,19 +15,21 @@
  */
 
 #include <opencv2/core.hpp>
-#include <opencv2/core/cuda.hpp>
 #include <opencv2/core/ocl.hpp>
-#include <opencv2/cudaarithm.hpp>
-#include <opencv2/cudafilters.hpp>
-#include <opencv2/cudaimgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <iostream>
+#include <sstream>
 #include <string>
 
+#include "alert_publisher.h"
+#include "batch.h"
 #include "config_store.h"
-#include "fps.h"
-#include "lane_detector.h"
+#include "cpu_kernels.h"
+#include "departure.h"
+#include "ldws.h"
+#include "stage_stats.h"
+#include "video_writer.h"
 
 using namespace std;
 using namespace cv;
@@ -38,30 +40,45 @@ int main(int argc, char* argv[])
 	ConfigStore *cs = ConfigStore::GetInstance();
 	cs->ParseConfig(argc, argv);
 
-	// Open video input file/device
-	VideoCapture capture(cs->video_in);
-	// If file open fails, try finding a camera indicated by an integer argument
-	if (!capture.isOpened())
-	{capture.open(atoi(cs->video_in.c_str()));}
+	// Created before any worker thread records into it
+	StageStats *stats = StageStats::GetInstance();
 
 	// Toggle OpenCL on/off
 	if (!cs->cuda_enabled)
 		cv::ocl::setUseOpenCL(cs->opencl_enabled);
 
+	// Batch mode processes the listed clips and exits
+	if (!cs->batch_input.empty()) {
+		BatchRunner batch(cs);
+		int ret = batch.Run();
+		if (!cs->stats_out.empty() && !stats->Dump(cs->stats_out))
+			cerr << "error: cannot write " << cs->stats_out << endl;
+		return ret;
+	}
+
+	// Detection and lane tracking run in the library, this is only the
+	// front end around it
+	LdwsDetector detector(*cs);
+	if (!detector.Open()) {
+		cerr << "error: cannot open " << cs->video_in << endl;
+		return 1;
+	}
+	if (!cs->record_trace.empty() && !detector.Tracing())
+		cerr << "error: cannot write " << cs->record_trace << endl;
+
 	string mode = "CPU";
 	if (cs->cuda_enabled)
 		mode = "CUDA";
 	else if (cs->opencl_enabled)
 		mode = "OpenCL";
 	cout << "Mode: " << mode << endl;
+	cout << "Kernels: " << GetCpuKernels().name << endl;
 
 	// Report video specs
-	double width = capture.get(CV_CAP_PROP_FRAME_WIDTH);
-	double height = capture.get(CV_CAP_PROP_FRAME_HEIGHT);
-	int ex = static_cast<int>(capture.get(CV_CAP_PROP_FOURCC));
-	char fourcc[] = {(char)(ex & 0XFF),(char)((ex & 0XFF00) >> 8),(char)((ex & 0XFF0000) >> 16),(char)((ex & 0XFF000000) >> 24),0};
-	Size frame_size(static_cast<int>(width), static_cast<int>(height));
-	cout << "Video: frame size " << width << "x" << height << ", codec " << fourcc << endl;
+	Size frame_size = detector.FrameSize();
+	int width = frame_size.width;
+	int height = frame_size.height;
+	cout << "Video: frame size " << width << "x" << height << ", codec " << detector.Codec() << endl;
 
 	// Create output window
 	string window_name = "Full Video";
@@ -69,114 +86,119 @@ int main(int argc, char* argv[])
 		namedWindow(window_name, CV_WINDOW_KEEPRATIO);
 	}
 
-	// FIXME this should be conditional
-	VideoWriter output_writer(cs->video_out, CV_FOURCC('P','I','M','1'), 30, frame_size, true);
-
-	Mat frame, edge;
-	Mat temp = Mat(height, width, CV_8UC3);
-	cv::cuda::GpuMat gpu_frame, gpu_gray, gpu_edge, gpu_lines;
-	UMat u_frame, u_gray, u_edge;
-	// FIXME need to error check for valid roi
-	Rect roi_rect = Rect(cs->roi.x, cs->roi.y, cs->roi.w, cs->roi.h);
-	cv::Ptr<cv::cuda::Filter> blur = cv::cuda::createGaussianFilter(CV_8UC1, CV_8UC1, Size(5, 5), 1.5);
-	cv::Ptr<cv::cuda::CannyEdgeDetector> canny = cv::cuda::createCannyEdgeDetector(cs->canny_min_thresh, cs->canny_max_thresh, 3, false);
-	double rho = 1;
-	double theta = CV_PI/180;
-	vector<Vec4i> lines;
-	cv::Ptr<cuda::HoughSegmentDetector> hough = cuda::createHoughSegmentDetector(rho, theta, cs->hough_min_length, cs->hough_max_gap);
-	LaneDetector ld;
-
-	frame_avg_init();
-
-	while (true)
-	{
-		capture >> frame;
-		if (frame.empty())
-			break;
-
-		// Display original frame
-		if (cs->intermediate_display) {
-			namedWindow("Original Video", WINDOW_AUTOSIZE);
-			imshow("Original Video", frame);
+	// Encoding runs behind the frame loop on its own thread
+	AsyncVideoWriter *output_writer = NULL;
+	if (cs->file_write) {
+		output_writer = new AsyncVideoWriter(cs);
+		if (!output_writer->Start(frame_size)) {
+			delete output_writer;
+			output_writer = NULL;
 		}
+	}
 
-		frame_begin();
-
-		if (cs->cuda_enabled) {
-			// CUDA implementation
-			gpu_frame.upload(frame);
-
-			// Set ROI to reduce workload
-			cv::cuda::GpuMat gpu_roi(gpu_frame, roi_rect);
-
-			// Convert to grayscale and blur
-			cv::cuda::cvtColor(gpu_roi, gpu_gray, CV_BGR2GRAY);
-			blur->apply(gpu_gray, gpu_gray);
-
-			// Canny edge detection
-			canny->detect(gpu_gray, gpu_edge);
-
-			// Probabilistic Hough line detection
-			hough->detect(gpu_edge, gpu_lines);
-			lines.resize(gpu_lines.cols);
-			Mat temp(1, gpu_lines.cols, CV_32SC4, &lines[0]);
-			gpu_lines.download(temp);
-		} else {
-			// TAPI implementation
-			frame.copyTo(u_frame);
-
-			// Set ROI to reduce workload
-			UMat u_roi(u_frame, roi_rect);
+	AlertPublisher alerts(cs);
+	alerts.Start();
 
-			// Convert to grayscale and blur
-			cvtColor(u_roi, u_gray, CV_BGR2GRAY);
-			GaussianBlur(u_gray, u_gray, Size(5, 5), 1.5);
+	LdwsResult lanes;
+	while (detector.Next(lanes))
+	{
+		// Departures are handed off before any rendering
+		for (int i = 0; i < lanes.departures; i++) {
+			DepartureEvent ev;
+			ev.frame = lanes.frame;
+			ev.capture_tick = lanes.capture_tick;
+			ev.right = lanes.departure[i].right;
+			ev.offset = lanes.departure[i].offset;
+			alerts.Publish(ev);
+		}
 
-			// Canny edge detection
-			Canny(u_gray, u_edge, cs->canny_min_thresh, cs->canny_max_thresh);
+		// Nothing to draw when the results are not looked at
+		if (cs->headless)
+			continue;
 
-			// Probabilistic Hough line detection
-			HoughLinesP(u_edge, lines, rho, theta, cs->hough_thresh, cs->hough_min_length, cs->hough_max_gap);
-		}
+		Mat &frame = detector.Image();
 
-		if (cs->cuda_enabled) {
-			gpu_edge.download(edge);
-		} else {
-			// Takes a reference
-			edge = u_edge.getMat(ACCESS_READ);
+		// Display original frame
+		if (cs->intermediate_display) {
+			namedWindow("Original Video", WINDOW_AUTOSIZE);
+			imshow("Original Video", frame);
 		}
-		ld.ProcessLanes(lines, frame, edge, temp);
 
-		// Release the reference taken in getMat()
-		if (!cs->cuda_enabled)
-			edge.release();
-
-		frame_end();
+		detector.DrawLanes(frame);
 
 		// Display Canny image
 		if (cs->intermediate_display) {
 			namedWindow("Edges");
-			if (cs->cuda_enabled) {
-				imshow("Edges", edge);
-			} else {
-				imshow("Edges", u_edge);
-			}
+			imshow("Edges", detector.Edge());
 		}
 
 		// Display FPS
+		stringstream fps;
+		fps << stats->CurrentFps();
 		putText(frame, "Mode: " + mode, Point(5, 30), FONT_HERSHEY_SIMPLEX, 1., Scalar(255, 100, 0), 2);
-		putText(frame, "FPS: " + frame_fps_str(), Point(5,60), FONT_HERSHEY_SIMPLEX, 1., Scalar(255, 100, 0), 2);
+		putText(frame, "FPS: " + fps.str(), Point(5,60), FONT_HERSHEY_SIMPLEX, 1., Scalar(255, 100, 0), 2);
+
+		// Queue frame for the output file
+		if (output_writer)
+			output_writer->Write(frame);
 
 		// Display full image
-		if (cs->display_enabled)
-			imshow(window_name, frame);
+		int key = -1;
+		if (cs->display_enabled || cs->intermediate_display) {
+			StageTimer t(STAGE_DISPLAY);
+			if (cs->display_enabled)
+				imshow(window_name, frame);
+			key = waitKey(1);
+		}
+
+		if (key == 27) break;
+	}
+
+	bool trace_written = detector.Close();
+	alerts.Stop();
+	if (output_writer)
+		output_writer->Stop();
+
+	cout << "Average FPS: " << stats->AverageFps() << endl;
+
+	if (cs->realtime)
+		cout << "Realtime: " << detector.DroppedFrames() << " frames dropped, "
+			<< detector.DegradedFrames() << " degraded, " << detector.MissedFrames() << " over budget" << endl;
+
+	const LatencyHistogram& alert_latency = stats->Get(STAGE_ALERT);
+	cout << "Departure alerts: " << alerts.Delivered() << " delivered, " << alerts.Dropped() << " dropped";
+	if (alert_latency.Count() > 0)
+		cout << ", capture to alert p50 " << alert_latency.Percentile(0.50) * 1e3
+			<< " ms, p99 " << alert_latency.Percentile(0.99) * 1e3
+			<< " ms, max " << alert_latency.Max() * 1e3 << " ms";
+	cout << endl;
+
+	if (detector.TracedFrames() >= 0) {
+		if (trace_written)
+			cout << "Trace: " << detector.TracedFrames() << " frames written to " << cs->record_trace << endl;
+		else
+			cerr << "error: cannot write " << cs->record_trace << endl;
+	}
 
-		// Write frame to output file
-		if (cs->file_write)
-			output_writer << frame;
+	if (output_writer) {
+		cout << "Encoder: " << output_writer->Written() << " frames written, "
+			<< output_writer->Dropped() << " dropped, queue depth mean "
+			<< output_writer->MeanDepth() << ", max " << output_writer->MaxDepth() << endl;
+		delete output_writer;
+	}
 
-		if (waitKey(1) == 27) break;
+#ifdef LDWS_ALLOC_DEBUG
+	if (stats->IsWarm()) {
+		cout << "Heap allocations after warm-up, per stage:" << endl;
+		for (int i = 0; i < NUM_STAGES; i++)
+			cout << "  " << StageStats::StageName((Stage)i) << ": " << stats->Allocs((Stage)i) << endl;
+		cout << "Heap allocations after warm-up, whole loop iterations:" << endl;
+		for (int i = 0; i < NUM_LOOP_THREADS; i++)
+			cout << "  " << StageStats::ThreadName((LoopThread)i) << " thread: "
+				<< stats->ThreadAllocs((LoopThread)i) << endl;
 	}
+#endif
 
-	cout << "Average FPS: " << frame_fps_avg_str() << endl;
+	if (!cs->stats_out.empty() && !stats->Dump(cs->stats_out))
+		cerr << "error: cannot write " << cs->stats_out << endl;
 }
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include "ocl_response_scan.h"
+#include "response_scan.h"
+
+using namespace cv;
+using namespace std;
+
+// Scalar versions of the helpers in response_scan.cc, see there for how
+// they reproduce LaneDetector::FindResponses
+static const char *response_scan_source =
+"inline int first_white_fwd(__global const uchar *p, int begin, int end, uchar t)\n"
+"{\n"
+"	for (int x = begin; x < end; x++)\n"
+"		if (p[x] > t)\n"
+"			return x;\n"
+"	return -1;\n"
+"}\n"
+"\n"
+"inline int last_white_bwd(__global const uchar *p, int begin, int end, uchar t)\n"
+"{\n"
+"	for (int x = end - 1; x >= begin; x--)\n"
+"		if (p[x] > t)\n"
+"			return x;\n"
+"	return -1;\n"
+"}\n"
+"\n"
+"inline int any_black(__global const uchar *p, int begin, int end, uchar t)\n"
+"{\n"
+"	for (int x = begin; x < end; x++)\n"
+"		if (p[x] <= t)\n"
+"			return 1;\n"
+"	return 0;\n"
+"}\n"
+"\n"
+"inline int scan_right(__global const uchar *p, int start, int end, int cols, uchar t)\n"
+"{\n"
+"	int x = first_white_fwd(p, start, end + 1, t);\n"
+"	if (x < 0)\n"
+"		return -1;\n"
+"	if (any_black(p, x + 1, min(end + 2, cols), t))\n"
+"		return x;\n"
+"	return (end + 2 < cols && p[end + 2] <= t) ? x : -1;\n"
+"}\n"
+"\n"
+"inline int scan_left(__global const uchar *p, int start, int end, uchar t)\n"
+"{\n"
+"	int x = last_white_bwd(p, end, start + 1, t);\n"
+"	if (x < 0)\n"
+"		return -1;\n"
+"	if (any_black(p, max(end - 1, 0), x, t))\n"
+"		return x;\n"
+"	return (end - 2 >= 0 && p[end - 2] <= t) ? x : -1;\n"
+"}\n"
+"\n"
+"inline int scan_row(__global const uchar *p, int start, int end, int cols, uchar t)\n"
+"{\n"
+"	return (end >= start) ? scan_right(p, start, end, cols, t) : scan_left(p, start, end, t);\n"
+"}\n"
+"\n"
+"__kernel void response_scan(__global const uchar *edge, int edge_step, int edge_offset,\n"
+"		int rows, int cols, __global int *result, int scan_rows, int step, int borderx,\n"
+"		int bw_thresh)\n"
+"{\n"
+"	int i = get_global_id(0);\n"
+"	if (i >= scan_rows)\n"
+"		return;\n"
+"\n"
+"	__global const uchar *p = edge + edge_offset + (rows - 1 - i * step) * edge_step;\n"
+"	int midx = cols / 2;\n"
+"	int left = -1, right = -1;\n"
+"	if (bw_thresh < 255) {\n"
+"		uchar t = (uchar)max(bw_thresh, 0);\n"
+"		left = scan_row(p, midx, borderx, cols, t);\n"
+"		right = scan_row(p, midx, cols - borderx, cols, t);\n"
+"	}\n"
+"	result[2 * i] = left;\n"
+"	result[2 * i + 1] = right;\n"
+"}\n";
+
+bool OclResponseScanner::Available()
+{
+	if (built)
+		return !kernel.empty();
+	built = true;
+
+	if (!ocl::useOpenCL())
+		return false;
+	ocl::ProgramSource source(response_scan_source);
+	String errors;
+	kernel.create("response_scan", source, "", &errors);
+	return !kernel.empty();
+}
+
+bool OclResponseScanner::Scan(const UMat& edge, int bw_thresh, int borderx, int step, ResponseScanner& out)
+{
+	CV_Assert(edge.type() == CV_8UC1 && step > 0);
+	if (!Available())
+		return false;
+
+	int rows = edge.rows > 0 ? (edge.rows - 1) / step + 1 : 0;
+	if (rows == 0) {
+		out.Set(NULL, 0, edge.size(), step);
+		return true;
+	}
+
+	u_result.create(1, 2 * rows, CV_32SC1);
+	kernel.args(ocl::KernelArg::ReadOnly(edge), ocl::KernelArg::PtrWriteOnly(u_result),
+			rows, step, borderx, min(bw_thresh, 255));
+	size_t global = rows;
+	if (!kernel.run(1, &global, NULL, true))
+		return false;
+
+	// The only transfer of the frame, two ints per scan row
+	u_result.copyTo(result);
+	out.Set(result.ptr<int>(), rows, edge.size(), step);
+	return true;
+}
+
+OclResponseScanner::OclResponseScanner()
+	: built(false)
+{
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef OCL_RESPONSE_SCAN_H
+#define OCL_RESPONSE_SCAN_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include "response_scan.h"
+
+using namespace cv;
+
+// ResponseScanner as an OpenCL kernel on an edge map that stays on the
+// device. Each work item scans one row for both sides with the scalar
+// logic of the host scanner, so the results are identical; only two
+// ints per scan row are read back.
+class OclResponseScanner
+{
+	public:
+		OclResponseScanner();
+		// Builds the kernel on first use, false without a usable device
+		bool Available();
+		bool Scan(const UMat& edge, int bw_thresh, int borderx, int step, ResponseScanner& out);
+
+	private:
+		ocl::Kernel kernel;
+		bool built;
+		UMat u_result;
+		Mat result;
+};
+
+#endif // OCL_RESPONSE_SCAN_H
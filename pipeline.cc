@@ -0,0 +1,187 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include <thread>
+#include <vector>
+
+#include "config_store.h"
+#include "frame.h"
+#include "frame_source.h"
+#include "lane_detector.h"
+#include "line_detector.h"
+#include "pipeline.h"
+#include "spsc_queue.h"
+#include "stage_stats.h"
+
+using namespace cv;
+using namespace std;
+
+// Frames queued per worker in each direction
+static const int QUEUE_DEPTH = 2;
+
+void Pipeline::DecodeLoop()
+{
+	long seq = 0;
+	Frame *f = NULL;
+
+	while (!stop.load(memory_order_relaxed)) {
+		LoopAllocScope allocs(THREAD_DECODE);
+		f = free_frames.Pop();
+		if (!source->Read(f))
+			break;
+		f->index = seq;
+		f->quality = quality.load(memory_order_relaxed);
+		f->last = false;
+		in_queues[seq % num_workers]->Push(f);
+		seq++;
+		f = NULL;
+	}
+
+	// Every worker gets an end of stream marker, starting with the one
+	// whose turn is next so the collector sees it right in order
+	for (int i = 0; i < num_workers; i++) {
+		if (!f)
+			f = free_frames.Pop();
+		f->last = true;
+		in_queues[(seq + i) % num_workers]->Push(f);
+		f = NULL;
+	}
+}
+
+void Pipeline::WorkerLoop(int id)
+{
+	while (true) {
+		LoopAllocScope allocs(THREAD_DETECT);
+		Frame *f = in_queues[id]->Pop();
+		if (!f->last) {
+			detectors[id]->Detect(f);
+			// Converting YUV input for rendering is per frame work too,
+			// and is skipped when nothing is rendered
+			if (!cs->headless)
+				f->EnsureImage();
+		}
+		out_queues[id]->Push(f);
+		if (f->last)
+			break;
+	}
+}
+
+Frame* Pipeline::Next()
+{
+	if (finished)
+		return NULL;
+
+	int id = next_index % num_workers;
+	Frame *f = out_queues[id]->Pop();
+	if (f->last) {
+		eos_seen[id] = true;
+		Release(f);
+		finished = true;
+		return NULL;
+	}
+
+	next_index++;
+	return f;
+}
+
+void Pipeline::Release(Frame *f)
+{
+	free_frames.Push(f);
+}
+
+void Pipeline::PublishLanes(long index, const LaneDetector& ld)
+{
+	lanes.Publish(index, ld.GetLaneState(false), ld.GetLaneState(true));
+}
+
+void Pipeline::Stop()
+{
+	stop.store(true);
+}
+
+void Pipeline::Finish()
+{
+	if (!decoder.joinable())
+		return;
+
+	Stop();
+	finished = true;
+	// Workers waiting for lanes that are no longer tracked go on
+	// without bands
+	lanes.Close();
+
+	// Drain whatever is still in flight so no stage blocks on a full queue
+	for (int i = 0; i < num_workers; i++) {
+		while (!eos_seen[i]) {
+			Frame *f = out_queues[i]->Pop();
+			eos_seen[i] = f->last;
+			Release(f);
+		}
+	}
+
+	decoder.join();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+}
+
+void Pipeline::Start()
+{
+	for (int i = 0; i < num_workers; i++)
+		workers.push_back(thread(&Pipeline::WorkerLoop, this, i));
+	decoder = thread(&Pipeline::DecodeLoop, this);
+}
+
+Pipeline::Pipeline(ConfigStore *cs, FrameSource *source, int workers)
+	: free_frames(workers * 2 * QUEUE_DEPTH + 2),
+	// A worker is at most its input queue and the frame it detects
+	// ahead of the lanes, so a fixed lag of that many frames per worker
+	// rarely makes one wait
+	lanes(max(workers, 1) * (QUEUE_DEPTH + 1))
+{
+	this->cs = cs;
+	this->source = source;
+	num_workers = workers > 0 ? workers : 1;
+	next_index = 0;
+	finished = false;
+	stop.store(false);
+	quality.store(QUALITY_FULL);
+
+	// Enough frames to fill every queue plus one being decoded and one
+	// being rendered; the pool never grows after this
+	pool.resize(num_workers * 2 * QUEUE_DEPTH + 2);
+	for (size_t i = 0; i < pool.size(); i++)
+		free_frames.Push(&pool[i]);
+
+	for (int i = 0; i < num_workers; i++) {
+		in_queues.push_back(new SpscQueue<Frame*>(QUEUE_DEPTH));
+		out_queues.push_back(new SpscQueue<Frame*>(QUEUE_DEPTH));
+		detectors.push_back(new LineDetector(cs, &lanes));
+		eos_seen.push_back(false);
+	}
+}
+
+Pipeline::~Pipeline()
+{
+	Finish();
+	for (int i = 0; i < num_workers; i++) {
+		delete in_queues[i];
+		delete out_queues[i];
+		delete detectors[i];
+	}
+}
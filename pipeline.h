@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <opencv2/core.hpp>
+#include <thread>
+#include <vector>
+
+#include "config_store.h"
+#include "frame.h"
+#include "frame_source.h"
+#include "lane_detector.h"
+#include "lane_snapshot.h"
+#include "line_detector.h"
+#include "spsc_queue.h"
+
+using namespace cv;
+using namespace std;
+
+// Staged frame pipeline: a decode thread feeds the detection workers
+// round-robin, and the caller collects the results in capture order
+// through Next(). Frames come from a fixed pool and must be handed
+// back with Release() once rendered.
+class Pipeline
+{
+	public:
+		Pipeline(ConfigStore *cs, FrameSource *source, int workers);
+		~Pipeline();
+		void Start();
+		Frame* Next();
+		void Release(Frame *f);
+		void Stop();
+		void Finish();
+
+		// Hands the lanes tracked up to frame index to the detection
+		// workers
+		void PublishLanes(long index, const LaneDetector& ld);
+		// Quality level given to frames read from now on
+		void SetQuality(int level) { quality.store(level, memory_order_relaxed); }
+
+	private:
+		void DecodeLoop();
+		void WorkerLoop(int id);
+
+		ConfigStore *cs;
+		FrameSource *source;
+		int num_workers;
+		long next_index;
+		vector<Frame> pool;
+		SpscQueue<Frame*> free_frames;
+		vector<SpscQueue<Frame*>*> in_queues, out_queues;
+		vector<LineDetector*> detectors;
+		LaneSnapshot lanes;
+		vector<bool> eos_seen;
+		thread decoder;
+		vector<thread> workers;
+		atomic<bool> stop;
+		atomic<int> quality;
+		bool finished;
+};
+
+#endif // PIPELINE_H
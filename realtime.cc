@@ -0,0 +1,154 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <thread>
+
+#include "frame.h"
+#include "frame_source.h"
+#include "realtime.h"
+
+using namespace cv;
+using namespace std;
+
+// Consecutive frames over budget before quality goes down
+static const int STEP_DOWN_FRAMES = 2;
+// Consecutive frames under HEADROOM of the budget before it goes up
+static const int STEP_UP_FRAMES = 30;
+static const double HEADROOM = 0.6;
+// Frames still in flight were detected at the old level, so they are
+// not held against the new one
+static const int SETTLE_FRAMES = 8;
+
+// Moves the pixels of one frame to another, the pipeline owned parts of
+// the frames stay where they are
+static void swap_pixels(Frame& a, Frame& b)
+{
+	swap(a.image, b.image);
+	swap(a.yuv, b.yuv);
+	swap(a.luma, b.luma);
+	swap(a.image_ready, b.image_ready);
+	swap(a.capture_tick, b.capture_tick);
+}
+
+void LatestFrameSource::GrabLoop()
+{
+	chrono::steady_clock::time_point next = chrono::steady_clock::now();
+	chrono::steady_clock::duration period =
+		chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(interval));
+	bool paced = !source->IsLive() && interval > 0;
+
+	while (!stop.load(memory_order_relaxed)) {
+		if (paced) {
+			this_thread::sleep_until(next);
+			next += period;
+		}
+
+		bool ok = source->Read(&grabbed);
+
+		unique_lock<mutex> guard(lock);
+		if (!ok) {
+			eos = true;
+			ready_cond.notify_all();
+			break;
+		}
+		if (has_ready)
+			dropped.fetch_add(1, memory_order_relaxed);
+		swap_pixels(grabbed, ready);
+		has_ready = true;
+		ready_cond.notify_all();
+	}
+}
+
+bool LatestFrameSource::Read(Frame *f)
+{
+	unique_lock<mutex> guard(lock);
+	while (!has_ready && !eos)
+		ready_cond.wait(guard);
+	if (!has_ready)
+		return false;
+
+	swap_pixels(*f, ready);
+	has_ready = false;
+	return true;
+}
+
+LatestFrameSource::LatestFrameSource(FrameSource *source, double interval)
+{
+	this->source = source;
+	this->interval = interval;
+	size = source->GetSize();
+	codec = source->GetCodec();
+	has_ready = false;
+	eos = !source->IsOpened();
+	stop.store(false);
+	dropped.store(0);
+
+	if (!eos)
+		grabber = thread(&LatestFrameSource::GrabLoop, this);
+}
+
+LatestFrameSource::~LatestFrameSource()
+{
+	stop.store(true);
+	if (grabber.joinable())
+		grabber.join();
+	delete source;
+}
+
+int QualityController::Update(double latency, int frame_level)
+{
+	if (latency > budget)
+		missed++;
+	if (frame_level > QUALITY_FULL)
+		degraded++;
+
+	if (settle > 0) {
+		settle--;
+		return level;
+	}
+
+	if (latency > budget) {
+		under = 0;
+		if (++over >= STEP_DOWN_FRAMES && level + 1 < NUM_QUALITY_LEVELS) {
+			level++;
+			over = 0;
+			settle = SETTLE_FRAMES;
+		}
+	} else if (latency < budget * HEADROOM) {
+		over = 0;
+		if (++under >= STEP_UP_FRAMES && level > QUALITY_FULL) {
+			level--;
+			under = 0;
+			settle = SETTLE_FRAMES;
+		}
+	} else {
+		over = 0;
+		under = 0;
+	}
+
+	return level;
+}
+
+QualityController::QualityController(double budget)
+{
+	this->budget = budget;
+	level = QUALITY_FULL;
+	over = under = settle = 0;
+	missed = degraded = 0;
+}
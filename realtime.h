@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+#include "frame.h"
+#include "frame_source.h"
+
+using namespace cv;
+using namespace std;
+
+// Reads the wrapped source on a grabber thread of its own and only keeps
+// the newest frame, so a slow frame never makes the ones after it wait
+// in line. Frames replaced before anyone read them count as dropped.
+// Sources that are not live are paced at one frame per interval to
+// stand in for a camera. Takes ownership of the source.
+class LatestFrameSource : public FrameSource
+{
+	public:
+		LatestFrameSource(FrameSource *source, double interval);
+		~LatestFrameSource();
+		bool IsOpened() const { return source->IsOpened(); }
+		bool Read(Frame *f);
+		Size GetSize() const { return size; }
+		string GetCodec() const { return codec; }
+		bool IsLive() const { return true; }
+
+		uint64_t Dropped() const { return dropped.load(memory_order_relaxed); }
+
+	private:
+		void GrabLoop();
+
+		FrameSource *source;
+		Size size;
+		string codec;
+		double interval;
+		// The grabber fills grabbed and swaps it with ready; readers swap
+		// ready with their own frame. Only Mat headers change hands.
+		Frame grabbed, ready;
+		bool has_ready;
+		bool eos;
+		mutex lock;
+		condition_variable ready_cond;
+		thread grabber;
+		atomic<bool> stop;
+		atomic<uint64_t> dropped;
+};
+
+// Picks the QualityLevel for the coming frames from the capture to
+// result latency of the frames done so far. Two frames over the budget
+// in a row step quality down, a long run well within it steps back up.
+class QualityController
+{
+	public:
+		QualityController(double budget);
+		// Takes the latency of a frame detected at frame_level and
+		// returns the level for the next frames
+		int Update(double latency, int frame_level);
+		int Level() const { return level; }
+
+		uint64_t Missed() const { return missed; }
+		uint64_t Degraded() const { return degraded; }
+
+	private:
+		double budget;
+		int level;
+		int over, under, settle;
+		uint64_t missed, degraded;
+};
+
+#endif // REALTIME_H
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "cpu_kernels.h"
+#include "edge_runs.h"
+#include "response_scan.h"
+
+using namespace cv;
+using namespace std;
+
+// True if any index in [begin, end) has p <= t. Runs of white are short
+// in a Canny image, so the first pixel almost always answers this.
+static bool any_black(const uchar *p, int begin, int end, uchar t)
+{
+	for (int x = begin; x < end; x++)
+		if (p[x] <= t)
+			return true;
+	return false;
+}
+
+// The reference scanner walks from start towards end over range pixels.
+// At the first white pixel x it follows the white run, but only while
+// range lasts, and range is not charged for x itself. So the response is
+// x when any of the pixels from x + step up to one past end is black,
+// and otherwise it comes down to the pixel two past end. Past the first
+// white pixel the scan never reports anything else.
+static int scan_right(const CpuKernels& k, const uchar *p, int start, int end, int cols, uchar t)
+{
+	int x = k.first_above(p, start, end + 1, t);
+	if (x < 0)
+		return -1;
+	int limit = min(end + 2, cols);
+	if (any_black(p, x + 1, limit, t))
+		return x;
+	return (end + 2 < cols && p[end + 2] <= t) ? x : -1;
+}
+
+static int scan_left(const CpuKernels& k, const uchar *p, int start, int end, uchar t)
+{
+	int x = k.last_above(p, end, start + 1, t);
+	if (x < 0)
+		return -1;
+	int limit = max(end - 1, 0);
+	if (any_black(p, limit, x, t))
+		return x;
+	return (end - 2 >= 0 && p[end - 2] <= t) ? x : -1;
+}
+
+static int scan_row(const CpuKernels& k, const uchar *p, int start, int end, int cols, uchar t)
+{
+	return (end >= start) ? scan_right(k, p, start, end, cols, t) : scan_left(k, p, start, end, t);
+}
+
+void ResponseScanner::Scan(const Mat& edge, int bw_thresh, int borderx, int step)
+{
+	CV_Assert(edge.type() == CV_8UC1 && step > 0);
+
+	int w = edge.cols;
+	int h = edge.rows;
+	int midx = w / 2;
+	int rows = h > 0 ? (h - 1) / step + 1 : 0;
+
+	// Nothing is white above 255
+	if (bw_thresh >= 255)
+		bw_thresh = 255;
+	uchar t = (uchar)max(bw_thresh, 0);
+
+	left.resize(rows);
+	right.resize(rows);
+	size = edge.size();
+	this->step = step;
+
+	// Black runs are skipped with the vector kernels
+	const CpuKernels& k = GetCpuKernels();
+	for (int i = 0; i < rows; i++) {
+		const uchar *p = edge.ptr<uchar>(h - 1 - i * step);
+		left[i] = bw_thresh >= 255 ? -1 : scan_row(k, p, midx, borderx, w, t);
+		right[i] = bw_thresh >= 255 ? -1 : scan_row(k, p, midx, w - borderx, w, t);
+	}
+}
+
+// scan_right and scan_left on runs. Pixels inside a run are white and
+// all others black, so the end of the run holding the first white pixel
+// decides the result.
+static int runs_right(const EdgeRuns::Run *r, const EdgeRuns::Run *end_run, int start, int end, int cols)
+{
+	for (; r < end_run && r->end <= start; r++)
+		;
+	if (r == end_run)
+		return -1;
+	int x = max(r->begin, start);
+	if (x > end)
+		return -1;
+	int limit = min(end + 2, cols);
+	if (r->end < limit)
+		return x;
+	return (end + 2 < cols && r->end == end + 2) ? x : -1;
+}
+
+static int runs_left(const EdgeRuns::Run *begin_run, const EdgeRuns::Run *r, int start, int end)
+{
+	for (; r > begin_run && r[-1].begin > start; r--)
+		;
+	if (r == begin_run)
+		return -1;
+	r--;
+	int x = min(r->end - 1, start);
+	if (x < end)
+		return -1;
+	int limit = max(end - 1, 0);
+	if (r->begin > limit)
+		return x;
+	return (end - 2 >= 0 && r->begin == end - 1) ? x : -1;
+}
+
+void ResponseScanner::Scan(const EdgeRuns& runs, int bw_thresh, int borderx, int step)
+{
+	CV_Assert(step > 0);
+
+	int w = runs.Cols();
+	int h = runs.Rows();
+	int midx = w / 2;
+	int rows = h > 0 ? (h - 1) / step + 1 : 0;
+
+	left.resize(rows);
+	right.resize(rows);
+	size = runs.EdgeSize();
+	this->step = step;
+
+	for (int i = 0; i < rows; i++) {
+		int y = h - 1 - i * step;
+		const EdgeRuns::Run *b = runs.RowBegin(y);
+		const EdgeRuns::Run *e = runs.RowEnd(y);
+		// Nothing is white above 255
+		if (bw_thresh >= 255) {
+			left[i] = right[i] = -1;
+			continue;
+		}
+		left[i] = (borderx >= midx) ? runs_right(b, e, midx, borderx, w) : runs_left(b, e, midx, borderx);
+		right[i] = (w - borderx >= midx) ? runs_right(b, e, midx, w - borderx, w) : runs_left(b, e, midx, w - borderx);
+	}
+}
+
+void ResponseScanner::Set(const int *pairs, int rows, Size edge_size, int step)
+{
+	left.resize(rows);
+	right.resize(rows);
+	for (int i = 0; i < rows; i++) {
+		left[i] = pairs[2 * i];
+		right[i] = pairs[2 * i + 1];
+	}
+	size = edge_size;
+	this->step = step;
+}
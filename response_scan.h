@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef RESPONSE_SCAN_H
+#define RESPONSE_SCAN_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "edge_runs.h"
+
+using namespace cv;
+using namespace std;
+
+// Finds the first /^\_ response of every scan row for both sides in one
+// pass over the edge map, with the same results as scanning each row
+// with LaneDetector::FindResponses from the middle outwards. Scan row i
+// is y = rows - 1 - i * step. Black runs are skipped 16 to 64 pixels at
+// a time by the kernels of cpu_kernels.h.
+class ResponseScanner
+{
+	public:
+		ResponseScanner():step(0){}
+		void Scan(const Mat& edge, int bw_thresh, int borderx, int step);
+		// The same scan over the runs of a binary (0 / 255) edge map,
+		// looking at the few runs near the middle of each row only
+		void Scan(const EdgeRuns& runs, int bw_thresh, int borderx, int step);
+		// Takes the results of a scan done elsewhere, rows (left, right)
+		// pairs for an edge map of the given size
+		void Set(const int *pairs, int rows, Size edge_size, int step);
+
+		int Rows() const { return left.size(); }
+		int Step() const { return step; }
+		Size EdgeSize() const { return size; }
+		// x of the response closest to the middle, or -1 for none
+		int Left(int i) const { return left[i]; }
+		int Right(int i) const { return right[i]; }
+
+	private:
+		vector<int> left, right;
+		Size size;
+		int step;
+};
+
+#endif // RESPONSE_SCAN_H
@@ -0,0 +1,37 @@
+# Side-parallel consistency test, run by ctest; see CMakeLists.txt.
+# Renders a synthetic clip with ldws-synth and runs batch mode on it
+# twice with the lane Hough engine, serially and with side_parallel,
+# then fails when the side-parallel lanes are more than MAX_ERROR
+# pixels away from the serial ones. ROI narrowing is off so that every
+# frame goes through the side-parallel path.
+
+FILE(REMOVE_RECURSE ${WORK_DIR})
+FILE(MAKE_DIRECTORY ${WORK_DIR}/serial ${WORK_DIR}/side)
+
+EXECUTE_PROCESS(
+	COMMAND ${SYNTH} --width ${WIDTH} --height ${HEIGHT} --frames ${FRAMES} ${WORK_DIR}/road
+	RESULT_VARIABLE RESULT)
+IF (NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "ldws-synth failed: ${RESULT}")
+ENDIF()
+
+FILE(READ ${WORK_DIR}/road.conf CONF)
+FILE(WRITE ${WORK_DIR}/serial.conf "${CONF}\nhough_engine = \"lane\";\nroi_narrowing = false;\nside_parallel = false;\n")
+FILE(WRITE ${WORK_DIR}/side.conf "${CONF}\nhough_engine = \"lane\";\nroi_narrowing = false;\nside_parallel = true;\n")
+
+EXECUTE_PROCESS(
+	COMMAND ${LDWS} -c ${WORK_DIR}/serial.conf --batch ${WORK_DIR}/road.y4m --jobs 1
+		--batch-out ${WORK_DIR}/serial
+	RESULT_VARIABLE RESULT)
+IF (NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "serial batch run failed: ${RESULT}")
+ENDIF()
+
+EXECUTE_PROCESS(
+	COMMAND ${LDWS} -c ${WORK_DIR}/side.conf --batch ${WORK_DIR}/road.y4m --jobs 1
+		--batch-out ${WORK_DIR}/side --batch-ref ${WORK_DIR}/serial
+		--batch-max-error ${MAX_ERROR}
+	RESULT_VARIABLE RESULT)
+IF (NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "side-parallel batch run failed: ${RESULT}")
+ENDIF()
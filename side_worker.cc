@@ -0,0 +1,80 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "side_worker.h"
+#include "stage_stats.h"
+
+using namespace std;
+
+void SideWorker::Loop()
+{
+	unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		cond.wait(lock, [this] { return busy || quit; });
+		if (quit)
+			break;
+
+		lock.unlock();
+		{
+			LoopAllocScope allocs(THREAD_SIDE);
+			job();
+		}
+		lock.lock();
+
+		busy = false;
+		cond.notify_all();
+	}
+}
+
+void SideWorker::Run(const function<void()>& job)
+{
+	// Started on first use, detectors that never split pay nothing
+	if (!worker.joinable())
+		worker = thread(&SideWorker::Loop, this);
+
+	lock_guard<std::mutex> lock(mutex);
+	this->job = job;
+	busy = true;
+	cond.notify_all();
+}
+
+void SideWorker::Wait()
+{
+	unique_lock<std::mutex> lock(mutex);
+	cond.wait(lock, [this] { return !busy; });
+}
+
+SideWorker::SideWorker()
+	: busy(false), quit(false)
+{
+}
+
+SideWorker::~SideWorker()
+{
+	if (!worker.joinable())
+		return;
+	{
+		lock_guard<std::mutex> lock(mutex);
+		quit = true;
+		cond.notify_all();
+	}
+	worker.join();
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef SIDE_WORKER_H
+#define SIDE_WORKER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// A second thread for the work of one lane side. The caller hands one
+// side to Run(), processes the other side itself, then calls Wait().
+// The thread lives as long as the worker, so a frame pays for a wakeup
+// rather than a thread start.
+class SideWorker
+{
+	public:
+		SideWorker();
+		~SideWorker();
+
+		void Run(const std::function<void()>& job);
+		void Wait();
+
+	private:
+		void Loop();
+
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::function<void()> job;
+		bool busy, quit;
+		std::thread worker;
+};
+
+#endif // SIDE_WORKER_H
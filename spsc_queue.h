@@ -0,0 +1,148 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+// Bounded lock-free single producer / single consumer ring buffer.
+// Exactly one thread may call the Push methods and exactly one thread
+// may call the Pop methods. TryPush / TryPop never block; Push / Pop
+// sleep until the other side makes room or hands over an item, or for
+// the cancellable Pop until it is interrupted.
+template <typename T>
+class SpscQueue {
+	public:
+		explicit SpscQueue(size_t capacity)
+			: slots(capacity + 1), head(0), tail(0), waiters(0) {}
+
+		bool TryPush(const T& item) {
+			if (!Put(item))
+				return false;
+			Wake();
+			return true;
+		}
+
+		bool TryPop(T& item) {
+			if (!Take(item))
+				return false;
+			Wake();
+			return true;
+		}
+
+		void Push(const T& item) {
+			if (!Put(item)) {
+				std::unique_lock<std::mutex> lock(wait_mutex);
+				Sleep();
+				while (!Put(item))
+					cond.wait(lock);
+				waiters.fetch_sub(1, std::memory_order_relaxed);
+			}
+			Wake();
+		}
+
+		T Pop() {
+			T item;
+			if (!Take(item)) {
+				std::unique_lock<std::mutex> lock(wait_mutex);
+				Sleep();
+				while (!Take(item))
+					cond.wait(lock);
+				waiters.fetch_sub(1, std::memory_order_relaxed);
+			}
+			Wake();
+			return item;
+		}
+
+		// Like Pop(), but gives up once cancel is set and the queue is
+		// empty. Whoever sets cancel calls Interrupt() after it.
+		bool Pop(T& item, const std::atomic<bool>& cancel) {
+			if (!Take(item)) {
+				std::unique_lock<std::mutex> lock(wait_mutex);
+				Sleep();
+				bool taken;
+				while (!(taken = Take(item)) && !cancel.load(std::memory_order_relaxed))
+					cond.wait(lock);
+				waiters.fetch_sub(1, std::memory_order_relaxed);
+				if (!taken)
+					return false;
+			}
+			Wake();
+			return true;
+		}
+
+		void Interrupt() { Wake(); }
+
+		size_t Size() const {
+			size_t h = head.load(std::memory_order_acquire);
+			size_t t = tail.load(std::memory_order_acquire);
+			return (t >= h) ? t - h : t + slots.size() - h;
+		}
+
+	private:
+		bool Put(const T& item) {
+			size_t t = tail.load(std::memory_order_relaxed);
+			size_t next = Next(t);
+			if (next == head.load(std::memory_order_acquire))
+				return false; // full
+			slots[t] = item;
+			tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		bool Take(T& item) {
+			size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))
+				return false; // empty
+			item = slots[h];
+			head.store(Next(h), std::memory_order_release);
+			return true;
+		}
+
+		size_t Next(size_t i) const { return (i + 1 == slots.size()) ? 0 : i + 1; }
+
+		// A sleeper announces itself before checking the indices again
+		// and the other side publishes an index before looking for
+		// sleepers, so one of them always sees the other. The wake up
+		// takes the mutex, which the sleeper holds until it waits.
+		void Sleep() {
+			waiters.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		void Wake() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiters.load(std::memory_order_relaxed) == 0)
+				return;
+			std::lock_guard<std::mutex> lock(wait_mutex);
+			cond.notify_all();
+		}
+
+		std::vector<T> slots;
+		// Keep producer and consumer indices on separate cache lines
+		alignas(64) std::atomic<size_t> head;
+		alignas(64) std::atomic<size_t> tail;
+		alignas(64) std::atomic<int> waiters;
+		std::mutex wait_mutex;
+		std::condition_variable cond;
+};
+
+#endif // SPSC_QUEUE_H
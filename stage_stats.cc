@@ -0,0 +1,202 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <atomic>
+#include <fstream>
+#include <math.h>
+#include <stdint.h>
+#include <string>
+
+#include "stage_stats.h"
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram()
+{
+	for (int i = 0; i < NUM_BUCKETS; i++)
+		buckets[i].store(0);
+	count.store(0);
+	sum_ns.store(0);
+	max_ns.store(0);
+	last_ns.store(0);
+}
+
+int LatencyHistogram::BucketIndex(uint64_t usec)
+{
+	// Values below SUB_BUCKETS are exact, above that each octave is
+	// split into SUB_BUCKETS equal parts
+	if (usec < SUB_BUCKETS)
+		return usec;
+
+	int octave = 63 - __builtin_clzll(usec);
+	int sub = (usec >> (octave - 4)) - SUB_BUCKETS;
+	int index = (octave - 3) * SUB_BUCKETS + sub;
+	return index < NUM_BUCKETS ? index : NUM_BUCKETS - 1;
+}
+
+double LatencyHistogram::BucketUpper(int index)
+{
+	if (index < SUB_BUCKETS)
+		return (index + 1) * 1e-6;
+
+	int octave = index / SUB_BUCKETS + 3;
+	int sub = index % SUB_BUCKETS;
+	return ((uint64_t)(SUB_BUCKETS + sub + 1) << (octave - 4)) * 1e-6;
+}
+
+void LatencyHistogram::Add(double seconds)
+{
+	uint64_t ns = seconds > 0 ? (uint64_t)(seconds * 1e9) : 0;
+
+	buckets[BucketIndex(ns / 1000)].fetch_add(1, memory_order_relaxed);
+	count.fetch_add(1, memory_order_relaxed);
+	sum_ns.fetch_add(ns, memory_order_relaxed);
+	last_ns.store(ns, memory_order_relaxed);
+
+	uint64_t prev = max_ns.load(memory_order_relaxed);
+	while (ns > prev && !max_ns.compare_exchange_weak(prev, ns, memory_order_relaxed))
+		;
+}
+
+double LatencyHistogram::Mean() const
+{
+	uint64_t n = Count();
+	return n ? sum_ns.load(memory_order_relaxed) * 1e-9 / n : 0;
+}
+
+double LatencyHistogram::Max() const
+{
+	return max_ns.load(memory_order_relaxed) * 1e-9;
+}
+
+double LatencyHistogram::Last() const
+{
+	return last_ns.load(memory_order_relaxed) * 1e-9;
+}
+
+double LatencyHistogram::Percentile(double p) const
+{
+	uint64_t n = Count();
+	if (n == 0)
+		return 0;
+
+	uint64_t target = (uint64_t)ceil(p * n);
+	if (target == 0)
+		target = 1;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < NUM_BUCKETS; i++) {
+		seen += buckets[i].load(memory_order_relaxed);
+		if (seen >= target)
+			return min(BucketUpper(i), Max());
+	}
+	return Max();
+}
+
+StageStats::StageStats()
+{
+	for (int i = 0; i < NUM_STAGES; i++)
+		allocs[i].store(0);
+	for (int i = 0; i < NUM_LOOP_THREADS; i++)
+		thread_allocs[i].store(0);
+	warm.store(false);
+}
+
+const char* StageStats::StageName(Stage stage)
+{
+	static const char* names[NUM_STAGES] = {
+		"upload", "gray", "blur", "coarse", "canny", "hough", "candidates", "side_left",
+		"side_right", "track", "overlay", "encode", "display", "alert", "frame"
+	};
+	return names[stage];
+}
+
+const char* StageStats::ThreadName(LoopThread thread)
+{
+	static const char* names[NUM_LOOP_THREADS] = { "decode", "detect", "side", "frame" };
+	return names[thread];
+}
+
+double StageStats::CurrentFps() const
+{
+	double last = stages[STAGE_FRAME].Last();
+	return last > 0 ? 1 / last : 0;
+}
+
+double StageStats::AverageFps() const
+{
+	double mean = stages[STAGE_FRAME].Mean();
+	return mean > 0 ? 1 / mean : 0;
+}
+
+bool StageStats::Dump(const string& path) const
+{
+	ofstream out(path.c_str());
+	if (!out)
+		return false;
+
+	bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+
+	// All latencies are reported in milliseconds
+	if (csv) {
+		out << "stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms";
+#ifdef LDWS_ALLOC_DEBUG
+		out << ",allocs";
+#endif
+		out << endl;
+	} else
+		out << "{" << endl;
+
+	for (int i = 0; i < NUM_STAGES; i++) {
+		const LatencyHistogram& h = stages[i];
+		if (csv) {
+			out << StageName((Stage)i) << "," << h.Count() << ","
+				<< h.Mean() * 1e3 << "," << h.Percentile(0.50) * 1e3 << ","
+				<< h.Percentile(0.95) * 1e3 << "," << h.Percentile(0.99) * 1e3 << ","
+				<< h.Max() * 1e3;
+#ifdef LDWS_ALLOC_DEBUG
+			out << "," << Allocs((Stage)i);
+#endif
+			out << endl;
+		} else {
+			out << "  \"" << StageName((Stage)i) << "\": {"
+				<< "\"count\": " << h.Count()
+				<< ", \"mean_ms\": " << h.Mean() * 1e3
+				<< ", \"p50_ms\": " << h.Percentile(0.50) * 1e3
+				<< ", \"p95_ms\": " << h.Percentile(0.95) * 1e3
+				<< ", \"p99_ms\": " << h.Percentile(0.99) * 1e3
+				<< ", \"max_ms\": " << h.Max() * 1e3;
+#ifdef LDWS_ALLOC_DEBUG
+			out << ", \"allocs\": " << Allocs((Stage)i);
+#endif
+			out << "}" << (i + 1 < NUM_STAGES ? "," : "") << endl;
+		}
+	}
+
+	if (!csv)
+		out << "}" << endl;
+
+	return true;
+}
+
+StageStats *StageStats::GetInstance()
+{
+	// Embedded detectors may record from several threads before anyone
+	// else asks for the instance, so creation has to be thread safe
+	static StageStats *instance = new StageStats;
+
+	return instance;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+
+#include <atomic>
+#include <opencv2/core/utility.hpp>
+#include <stdint.h>
+#include <string>
+
+#include "alloc_count.h"
+
+enum Stage {
+	STAGE_UPLOAD,       // host <-> device copies
+	STAGE_GRAY,
+	STAGE_BLUR,
+	STAGE_COARSE,       // line search on a pyramid level
+	STAGE_CANNY,
+	STAGE_HOUGH,
+	STAGE_CANDIDATES,   // sorting Hough lines into lane candidates
+	STAGE_SIDE_LEFT,
+	STAGE_SIDE_RIGHT,
+	STAGE_TRACK,        // following the lanes on frames without Hough
+	STAGE_OVERLAY,
+	STAGE_ENCODE,
+	STAGE_DISPLAY,
+	STAGE_ALERT,        // capture to departure alert delivered
+	STAGE_FRAME,        // interval between frames leaving the pipeline
+	NUM_STAGES
+};
+
+// Threads of the frame loop, for allocation counts over whole loop
+// iterations rather than single stages
+enum LoopThread {
+	THREAD_DECODE,
+	THREAD_DETECT,      // pipeline detection workers
+	THREAD_SIDE,        // side workers of detection and lane tracking
+	THREAD_FRAME,       // LdwsDetector::Next on the caller's thread
+	NUM_LOOP_THREADS
+};
+
+// Latency histogram with logarithmic buckets, 16 per power of two of
+// microseconds. Recording is wait-free, so any thread may add samples.
+class LatencyHistogram
+{
+	public:
+		LatencyHistogram();
+		void Add(double seconds);
+		uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+		double Mean() const;
+		double Max() const;
+		double Last() const;
+		double Percentile(double p) const;
+
+	private:
+		static const int SUB_BUCKETS = 16;
+		static const int NUM_BUCKETS = 32 * SUB_BUCKETS;
+		static int BucketIndex(uint64_t usec);
+		static double BucketUpper(int index);
+
+		std::atomic<uint64_t> buckets[NUM_BUCKETS];
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> sum_ns;
+		std::atomic<uint64_t> max_ns;
+		std::atomic<uint64_t> last_ns;
+};
+
+// Process-wide per-stage latency statistics
+class StageStats
+{
+	public:
+		static StageStats* GetInstance();
+		static const char* StageName(Stage stage);
+		static const char* ThreadName(LoopThread thread);
+
+		void Record(Stage stage, double seconds) { stages[stage].Add(seconds); }
+		const LatencyHistogram& Get(Stage stage) const { return stages[stage]; }
+
+		// Heap allocations made inside each stage once the frame loop
+		// is warmed up, counted with LDWS_ALLOC_DEBUG builds only
+		void SetWarm() { warm.store(true, std::memory_order_relaxed); }
+		bool IsWarm() const { return warm.load(std::memory_order_relaxed); }
+		void RecordAllocs(Stage stage, uint64_t n) { allocs[stage].fetch_add(n, std::memory_order_relaxed); }
+		uint64_t Allocs(Stage stage) const { return allocs[stage].load(std::memory_order_relaxed); }
+		// The same for every allocation of a thread, hand-offs and
+		// bookkeeping between the stages included
+		void RecordThreadAllocs(LoopThread thread, uint64_t n) {
+			thread_allocs[thread].fetch_add(n, std::memory_order_relaxed);
+		}
+		uint64_t ThreadAllocs(LoopThread thread) const {
+			return thread_allocs[thread].load(std::memory_order_relaxed);
+		}
+
+		double CurrentFps() const;
+		double AverageFps() const;
+
+		// Writes all stages as JSON, or CSV when the name ends in .csv
+		bool Dump(const std::string& path) const;
+
+	private:
+		StageStats();
+
+		LatencyHistogram stages[NUM_STAGES];
+		std::atomic<uint64_t> allocs[NUM_STAGES];
+		std::atomic<uint64_t> thread_allocs[NUM_LOOP_THREADS];
+		std::atomic<bool> warm;
+};
+
+// Records the lifetime of the enclosing scope against a stage, or the
+// time until Stop() when that comes first
+class StageTimer
+{
+	public:
+		explicit StageTimer(Stage stage): stage(stage), begin(cv::getTickCount()), running(true) {
+#ifdef LDWS_ALLOC_DEBUG
+			alloc_begin = ThreadAllocCount();
+#endif
+		}
+		~StageTimer() { Stop(); }
+
+		void Stop() {
+			if (!running)
+				return;
+			running = false;
+			StageStats *stats = StageStats::GetInstance();
+			stats->Record(stage, (cv::getTickCount() - begin) / cv::getTickFrequency());
+#ifdef LDWS_ALLOC_DEBUG
+			if (stats->IsWarm())
+				stats->RecordAllocs(stage, ThreadAllocCount() - alloc_begin);
+#endif
+		}
+
+	private:
+		Stage stage;
+		int64_t begin;
+		bool running;
+#ifdef LDWS_ALLOC_DEBUG
+		uint64_t alloc_begin;
+#endif
+};
+
+// Counts the heap allocations of one loop iteration against its thread.
+// Iterations that start before the warm-up is over are left out.
+class LoopAllocScope
+{
+	public:
+		explicit LoopAllocScope(LoopThread thread) {
+#ifdef LDWS_ALLOC_DEBUG
+			this->thread = thread;
+			warm = StageStats::GetInstance()->IsWarm();
+			begin = ThreadAllocCount();
+#else
+			(void)thread;
+#endif
+		}
+		~LoopAllocScope() {
+#ifdef LDWS_ALLOC_DEBUG
+			if (warm)
+				StageStats::GetInstance()->RecordThreadAllocs(thread, ThreadAllocCount() - begin);
+#endif
+		}
+
+	private:
+#ifdef LDWS_ALLOC_DEBUG
+		LoopThread thread;
+		bool warm;
+		uint64_t begin;
+#endif
+};
+
+#endif // STAGE_STATS_H
@@ -0,0 +1,33 @@
+# Streaming determinism test, run by ctest; see CMakeLists.txt.
+# Renders a synthetic clip with ldws-synth and runs the threaded
+# front end on it twice with the same settings, recording a trace each
+# time. The detection workers predict the lane bands from lanes the
+# frame loop tracks concurrently, and the two traces must still be
+# identical.
+
+FILE(REMOVE_RECURSE ${WORK_DIR})
+FILE(MAKE_DIRECTORY ${WORK_DIR})
+
+EXECUTE_PROCESS(
+	COMMAND ${SYNTH} --width ${WIDTH} --height ${HEIGHT} --frames ${FRAMES} ${WORK_DIR}/road
+	RESULT_VARIABLE RESULT)
+IF (NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "ldws-synth failed: ${RESULT}")
+ENDIF()
+
+FOREACH(RUN 1 2)
+	EXECUTE_PROCESS(
+		COMMAND ${LDWS} -c ${WORK_DIR}/road.conf -d --threads ${THREADS}
+			--record-trace ${WORK_DIR}/run${RUN}.trace
+		RESULT_VARIABLE RESULT)
+	IF (NOT RESULT EQUAL 0)
+		MESSAGE(FATAL_ERROR "streaming run ${RUN} failed: ${RESULT}")
+	ENDIF()
+ENDFOREACH()
+
+EXECUTE_PROCESS(
+	COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/run1.trace ${WORK_DIR}/run2.trace
+	RESULT_VARIABLE RESULT)
+IF (NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "streaming runs on the same clip tracked different lanes")
+ENDIF()
@@ -0,0 +1,391 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// ldws-sweep tunes the detection parameters. Every clip is decoded once
+// into a FrameCache of blurred ROI frames, then each combination of the
+// given canny, hough and line_reject values runs Canny, Hough and
+// LaneDetector over all cached frames. The combinations run in parallel,
+// sharing the read-only caches, and are ranked by stability (frames with
+// a lost lane, frame to frame jitter of the tracked k and b) and by
+// speed.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <tclap/CmdLine.h>
+#include <thread>
+#include <vector>
+
+#include "birdseye.h"
+#include "config.h"
+#include "config_store.h"
+#include "frame_cache.h"
+#include "frame_source.h"
+#include "lane_detector.h"
+#include "lane_hough.h"
+
+using namespace cv;
+using namespace std;
+
+enum Param {
+	PARAM_CANNY_MIN,
+	PARAM_CANNY_MAX,
+	PARAM_HOUGH_THRESH,
+	PARAM_HOUGH_MIN_LENGTH,
+	PARAM_HOUGH_MAX_GAP,
+	PARAM_LINE_REJECT,
+	NUM_PARAMS
+};
+
+static const char *param_names[NUM_PARAMS] = {
+	"canny_min", "canny_max", "hough_thresh", "hough_min_len", "hough_max_gap", "reject"
+};
+
+struct SetResult {
+	SetResult():frames(0),seconds(0),lost(0),k_jitter(0),b_jitter(0),steps(0){}
+	int params[NUM_PARAMS];
+	long frames;
+	double seconds;         // Canny, Hough and lane fitting only
+	long lost;              // frames with a lane that is not locked
+	double k_jitter, b_jitter;
+	long steps;             // frame to frame steps of locked lanes
+
+	double MsPerFrame() const { return frames ? 1000 * seconds / frames : 0; }
+	double LostFraction() const { return frames ? (double)lost / frames : 1; }
+	double KJitter() const { return steps ? k_jitter / steps : 0; }
+	double BJitter() const { return steps ? b_jitter / steps : 0; }
+};
+
+struct Sweep {
+	const ConfigStore *cs;
+	vector<string> clips;
+	vector<FrameCache*> caches;
+	vector<SetResult> results;
+	atomic<size_t> next;
+};
+
+static string clip_basename(const string& path)
+{
+	size_t slash = path.find_last_of('/');
+	string name = (slash == string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == string::npos) ? name : name.substr(0, dot);
+}
+
+// "a,b,c" or "first:last:step"; an empty list keeps the config value
+static bool parse_values(const string& spec, int def, vector<int>& values)
+{
+	values.clear();
+	if (spec.empty()) {
+		values.push_back(def);
+		return true;
+	}
+
+	int first, last, step;
+	if (sscanf(spec.c_str(), "%d:%d:%d", &first, &last, &step) == 3) {
+		if (step <= 0 || last < first)
+			return false;
+		for (int v = first; v <= last; v += step)
+			values.push_back(v);
+		return true;
+	}
+
+	size_t pos = 0;
+	while (pos <= spec.size()) {
+		size_t comma = spec.find(',', pos);
+		if (comma == string::npos)
+			comma = spec.size();
+		char *end;
+		string item = spec.substr(pos, comma - pos);
+		long v = strtol(item.c_str(), &end, 10);
+		if (item.empty() || *end)
+			return false;
+		values.push_back(v);
+		pos = comma + 1;
+	}
+	return true;
+}
+
+static void apply_params(const int *params, ConfigStore& cfg)
+{
+	cfg.canny_min_thresh = params[PARAM_CANNY_MIN];
+	cfg.canny_max_thresh = params[PARAM_CANNY_MAX];
+	cfg.hough_thresh = params[PARAM_HOUGH_THRESH];
+	cfg.hough_min_length = params[PARAM_HOUGH_MIN_LENGTH];
+	cfg.hough_max_gap = params[PARAM_HOUGH_MAX_GAP];
+	cfg.line_reject_degrees = params[PARAM_LINE_REJECT];
+}
+
+static void evaluate(const Sweep& sweep, SetResult& result)
+{
+	// Private configuration and detectors, only the caches are shared
+	ConfigStore cfg(*sweep.cs);
+	apply_params(result.params, cfg);
+	LaneHough lane_hough(&cfg);
+	BirdsEye birdseye(&cfg);
+	Mat edge;
+	vector<Vec4i> lines;
+
+	for (size_t c = 0; c < sweep.caches.size(); c++) {
+		const FrameCache *cache = sweep.caches[c];
+		LaneDetector lane_detector(&cfg);
+		LaneDetector::LaneState prev[2];
+		bool prev_locked[2] = { false, false };
+
+		for (long i = 0; i < cache->Frames(); i++) {
+			Mat gray = cache->Get(i);
+
+			double begin = getTickCount();
+			Canny(gray, edge, cfg.canny_min_thresh, cfg.canny_max_thresh);
+			int left_lines = -1;
+			if (cfg.hough_engine == "lane")
+				left_lines = lane_hough.Detect(edge, lines);
+			else if (cfg.hough_engine == "birdseye")
+				left_lines = birdseye.Detect(edge, lines);
+			else
+				HoughLinesP(edge, lines, 1, CV_PI/180, cfg.hough_thresh,
+						cfg.hough_min_length, cfg.hough_max_gap);
+			lane_detector.ProcessLanes(lines, edge, cache->FrameWidth(), left_lines);
+			result.seconds += ((double)getTickCount() - begin) / getTickFrequency();
+
+			bool lost = false;
+			for (int s = 0; s < 2; s++) {
+				LaneDetector::LaneState lane = lane_detector.GetLaneState(s == 1);
+				bool locked = !lane.reset && lane.lost == 0 && std::isfinite(lane.k + lane.b);
+				if (locked && prev_locked[s]) {
+					result.k_jitter += fabs(lane.k - prev[s].k);
+					result.b_jitter += fabs(lane.b - prev[s].b);
+					result.steps++;
+				}
+				lost = lost || !locked;
+				prev[s] = lane;
+				prev_locked[s] = locked;
+			}
+			if (lost)
+				result.lost++;
+			result.frames++;
+		}
+	}
+}
+
+static void worker_loop(Sweep *sweep)
+{
+	while (true) {
+		size_t i = sweep->next.fetch_add(1);
+		if (i >= sweep->results.size())
+			break;
+		evaluate(*sweep, sweep->results[i]);
+	}
+}
+
+static bool more_stable(const SetResult& a, const SetResult& b)
+{
+	if (a.lost != b.lost)
+		return a.lost < b.lost;
+	if (a.BJitter() != b.BJitter())
+		return a.BJitter() < b.BJitter();
+	return a.KJitter() < b.KJitter();
+}
+
+static bool faster(const SetResult& a, const SetResult& b)
+{
+	return a.MsPerFrame() < b.MsPerFrame();
+}
+
+static void print_ranking(const char *title, const vector<SetResult>& results, int top)
+{
+	cout << title << endl;
+	for (int p = 0; p < NUM_PARAMS; p++)
+		printf("%14s", param_names[p]);
+	printf("%9s%10s%10s%10s\n", "lost %", "|dk|", "|db| px", "ms/frame");
+	for (int i = 0; i < top && i < (int)results.size(); i++) {
+		const SetResult& r = results[i];
+		for (int p = 0; p < NUM_PARAMS; p++)
+			printf("%14d", r.params[p]);
+		printf("%9.2f%10.4f%10.2f%10.3f\n", 100 * r.LostFraction(), r.KJitter(), r.BJitter(),
+				r.MsPerFrame());
+	}
+	cout << endl;
+}
+
+static void write_csv(const string& name, const vector<SetResult>& results)
+{
+	ofstream out(name.c_str());
+	if (!out) {
+		cerr << "error: cannot write " << name << endl;
+		return;
+	}
+	for (int p = 0; p < NUM_PARAMS; p++)
+		out << param_names[p] << ",";
+	out << "frames,lost,k_jitter,b_jitter,ms_per_frame" << endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		const SetResult& r = results[i];
+		for (int p = 0; p < NUM_PARAMS; p++)
+			out << r.params[p] << ",";
+		out << r.frames << "," << r.lost << "," << r.KJitter() << "," << r.BJitter() << ","
+			<< r.MsPerFrame() << endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	ConfigStore *cs = ConfigStore::GetInstance();
+	string input, cache_dir, out_name;
+	string specs[NUM_PARAMS];
+	int jobs, top;
+
+	try {
+		TCLAP::CmdLine cmd_line("Detection parameter sweep", ' ', LDWS_VERSION);
+		TCLAP::ValueArg<string> config_file_string("c","config-file","Configuration file name", false, "ldws.conf", "filename");
+		cmd_line.add(config_file_string);
+		TCLAP::ValueArg<string> cache_dir_string("","cache-dir","Directory for the preprocessed frame caches", false, ".", "directory");
+		cmd_line.add(cache_dir_string);
+		TCLAP::ValueArg<int> jobs_int("j","jobs","Number of parameter sets evaluated in parallel", false, 0, "count");
+		cmd_line.add(jobs_int);
+		TCLAP::ValueArg<int> top_int("n","top","Number of parameter sets shown per ranking", false, 10, "count");
+		cmd_line.add(top_int);
+		TCLAP::ValueArg<string> out_string("","out","Write the results of all parameter sets as CSV", false, "", "filename");
+		cmd_line.add(out_string);
+		TCLAP::ValueArg<string> canny_min_string("","canny-min","canny_min_thresh values", false, "", "a,b,..|first:last:step");
+		cmd_line.add(canny_min_string);
+		TCLAP::ValueArg<string> canny_max_string("","canny-max","canny_max_thresh values", false, "", "a,b,..|first:last:step");
+		cmd_line.add(canny_max_string);
+		TCLAP::ValueArg<string> hough_thresh_string("","hough-thresh","hough_thresh values", false, "", "a,b,..|first:last:step");
+		cmd_line.add(hough_thresh_string);
+		TCLAP::ValueArg<string> hough_min_length_string("","hough-min-length","hough_min_length values", false, "", "a,b,..|first:last:step");
+		cmd_line.add(hough_min_length_string);
+		TCLAP::ValueArg<string> hough_max_gap_string("","hough-max-gap","hough_max_gap values", false, "", "a,b,..|first:last:step");
+		cmd_line.add(hough_max_gap_string);
+		TCLAP::ValueArg<string> reject_string("","line-reject","line_reject_degrees values", false, "", "a,b,..|first:last:step");
+		cmd_line.add(reject_string);
+		TCLAP::UnlabeledValueArg<string> input_string("input","List file or glob pattern of input videos, or video_input_file when empty", false, "", "list|glob");
+		cmd_line.add(input_string);
+		cmd_line.parse(argc, argv);
+
+		cs->ParseConfigFile(config_file_string.getValue());
+		input = input_string.getValue();
+		cache_dir = cache_dir_string.getValue();
+		jobs = jobs_int.getValue();
+		top = top_int.getValue();
+		out_name = out_string.getValue();
+		specs[PARAM_CANNY_MIN] = canny_min_string.getValue();
+		specs[PARAM_CANNY_MAX] = canny_max_string.getValue();
+		specs[PARAM_HOUGH_THRESH] = hough_thresh_string.getValue();
+		specs[PARAM_HOUGH_MIN_LENGTH] = hough_min_length_string.getValue();
+		specs[PARAM_HOUGH_MAX_GAP] = hough_max_gap_string.getValue();
+		specs[PARAM_LINE_REJECT] = reject_string.getValue();
+	} catch (TCLAP::ArgException &e) {
+		cerr << "error: " << e.error() << " for arg " << e.argId() << endl;
+		return 1;
+	}
+
+	// The grid is the cross product of all value lists
+	int defaults[NUM_PARAMS] = {
+		cs->canny_min_thresh, cs->canny_max_thresh, cs->hough_thresh,
+		cs->hough_min_length, cs->hough_max_gap, cs->line_reject_degrees
+	};
+	vector<int> values[NUM_PARAMS];
+	size_t grid = 1;
+	for (int p = 0; p < NUM_PARAMS; p++) {
+		if (!parse_values(specs[p], defaults[p], values[p])) {
+			cerr << "error: bad " << param_names[p] << " values " << specs[p] << endl;
+			return 1;
+		}
+		grid *= values[p].size();
+	}
+
+	Sweep sweep;
+	sweep.cs = cs;
+	if (input.empty())
+		sweep.clips.push_back(cs->video_in);
+	else
+		FrameSource::ExpandInputs(input, sweep.clips);
+	if (sweep.clips.empty()) {
+		cerr << "error: no sweep inputs" << endl;
+		return 1;
+	}
+
+	sweep.results.resize(grid);
+	for (size_t i = 0; i < grid; i++) {
+		size_t rest = i;
+		for (int p = NUM_PARAMS - 1; p >= 0; p--) {
+			sweep.results[i].params[p] = values[p][rest % values[p].size()];
+			rest /= values[p].size();
+		}
+	}
+
+	if (jobs <= 0)
+		jobs = thread::hardware_concurrency();
+	if (jobs <= 0)
+		jobs = 1;
+	if (jobs > (int)grid)
+		jobs = grid;
+
+	// Parallelism comes from running parameter sets side by side
+	setNumThreads(1);
+
+	// Decode every clip once, a cache from an earlier run is reused
+	long total_frames = 0;
+	for (size_t c = 0; c < sweep.clips.size(); c++) {
+		ConfigStore cfg(*cs);
+		cfg.video_in = sweep.clips[c];
+		FrameCache *cache = new FrameCache();
+		string path = cache_dir + "/" + clip_basename(sweep.clips[c]) + ".blur";
+		if (!cache->Open(&cfg, path)) {
+			cerr << "error: cannot cache " << sweep.clips[c] << endl;
+			delete cache;
+			continue;
+		}
+		total_frames += cache->Frames();
+		sweep.caches.push_back(cache);
+	}
+	if (sweep.caches.empty())
+		return 1;
+
+	cout << "Sweep: " << grid << " parameter sets, " << sweep.caches.size() << " clips, "
+		<< total_frames << " frames, " << jobs << " jobs" << endl;
+
+	double begin = getTickCount();
+	sweep.next.store(0);
+	vector<thread> workers;
+	for (int i = 0; i < jobs; i++)
+		workers.push_back(thread(worker_loop, &sweep));
+	for (int i = 0; i < jobs; i++)
+		workers[i].join();
+	double wall = ((double)getTickCount() - begin) / getTickFrequency();
+	cout << "Sweep: done in " << wall << " s" << endl << endl;
+
+	vector<SetResult> ranked = sweep.results;
+	stable_sort(ranked.begin(), ranked.end(), more_stable);
+	print_ranking("Most stable:", ranked, top);
+	stable_sort(ranked.begin(), ranked.end(), faster);
+	print_ranking("Fastest:", ranked, top);
+
+	if (!out_name.empty())
+		write_csv(out_name, sweep.results);
+
+	for (size_t c = 0; c < sweep.caches.size(); c++)
+		delete sweep.caches[c];
+	return 0;
+}
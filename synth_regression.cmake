@@ -0,0 +1,33 @@
+# Accuracy and speed regression tests, run by ctest; see CMakeLists.txt.
+# Renders a synthetic clip with ldws-synth and runs batch mode on it.
+# With MAX_ERROR the mean lane error against the ground truth must not
+# be above that many pixels, with MIN_FPS the frame rate must not be
+# below it. The per-stage latencies are left in
+# ${WORK_DIR}/results/stats.json.
+
+FILE(REMOVE_RECURSE ${WORK_DIR})
+FILE(MAKE_DIRECTORY ${WORK_DIR}/results)
+
+EXECUTE_PROCESS(
+	COMMAND ${SYNTH} --width ${WIDTH} --height ${HEIGHT} --frames ${FRAMES} ${WORK_DIR}/road
+	RESULT_VARIABLE RESULT)
+IF (NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "ldws-synth failed: ${RESULT}")
+ENDIF()
+
+SET(CHECKS)
+IF (DEFINED MAX_ERROR)
+	LIST(APPEND CHECKS --batch-ref ${WORK_DIR} --batch-max-error ${MAX_ERROR})
+ENDIF()
+IF (DEFINED MIN_FPS)
+	LIST(APPEND CHECKS --batch-min-fps ${MIN_FPS})
+ENDIF()
+
+EXECUTE_PROCESS(
+	COMMAND ${LDWS} -c ${WORK_DIR}/road.conf --batch ${WORK_DIR}/road*.y4m --jobs 1
+		--batch-out ${WORK_DIR}/results ${CHECKS}
+		--stats-out ${WORK_DIR}/results/stats.json
+	RESULT_VARIABLE RESULT)
+IF (NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "batch run failed: ${RESULT}")
+ENDIF()
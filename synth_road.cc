@@ -0,0 +1,233 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// ldws-synth renders synthetic road clips with known lane lines. Each
+// clip is written as <name>.y4m together with <name>.csv, the ground
+// truth in the per-frame format of batch mode, and <name>.conf, a config
+// file with a matching ROI. Batch mode with --batch-ref then scores the
+// detector against the ground truth, and --stats-out times each stage.
+
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <opencv2/core.hpp>
+#include <stdio.h>
+#include <string>
+#include <tclap/CmdLine.h>
+#include <vector>
+
+#include "config.h"
+
+using namespace cv;
+using namespace std;
+
+struct Scene {
+	int width, height;
+	int frames;
+	double curvature;       // lateral bend at the horizon, in lane widths
+	double drift;           // amplitude of the vehicle's lateral motion
+	double noise;           // sensor noise sigma
+	double lighting;        // amplitude of the brightness changes
+	int dash_period;        // frames per dash cycle of the right marking
+	unsigned seed;
+};
+
+// Rows from the horizon down to the bottom of the frame; markings are
+// straight lines through the vanishing point bent by the curvature
+struct Road {
+	double cx, horizon;
+	double lane_width;      // at the bottom row, in pixels
+
+	// Normalized distance from the horizon, 1 at the bottom row
+	double Depth(const Scene& s, int y) const { return (y - horizon) / (s.height - horizon); }
+
+	double MarkingX(const Scene& s, double lateral, double curvature, int y) const {
+		double d = Depth(s, y);
+		return cx + lateral * lane_width * d + curvature * lane_width * (1 - d) * (1 - d);
+	}
+};
+
+static Rect scene_roi(const Scene& s, const Road& road)
+{
+	// From a bit below the horizon down to just above the hood
+	int top = (int)(road.horizon + (s.height - road.horizon) * 0.15);
+	int bottom = s.height - s.height / 20;
+	return Rect(0, top, s.width, bottom - top);
+}
+
+// Least squares line y = kx + b through a marking over the ROI rows, in
+// ROI coordinates like the detector's lanes
+static void fit_marking(const Scene& s, const Road& road, const Rect& roi, double lateral,
+		double curvature, float& k, float& b)
+{
+	double n = 0, sy = 0, sx = 0, syy = 0, sxy = 0;
+	for (int y = roi.y; y < roi.y + roi.height; y++) {
+		double x = road.MarkingX(s, lateral, curvature, y) - roi.x;
+		double yr = y - roi.y;
+		n++;
+		sy += yr;
+		sx += x;
+		syy += yr * yr;
+		sxy += x * yr;
+	}
+	double p = (n * sxy - sx * sy) / (n * syy - sy * sy);
+	double q = (sx - p * sy) / n;
+	k = 1 / p;
+	b = -q / p;
+}
+
+static void render(const Scene& s, const Road& road, int t, double lateral[2], double curvature,
+		RNG& rng, Mat& gray, Mat& noise)
+{
+	double gain = 1 + s.lighting * sin(2 * CV_PI * t / 150.0);
+	int sky = saturate_cast<uchar>(170 * gain);
+	int asphalt = saturate_cast<uchar>(80 * gain);
+	int paint = saturate_cast<uchar>(220 * gain);
+
+	gray.setTo(sky);
+	for (int y = (int)road.horizon + 1; y < s.height; y++) {
+		uchar *row = gray.ptr<uchar>(y);
+		double d = road.Depth(s, y);
+		for (int x = 0; x < s.width; x++)
+			row[x] = asphalt;
+
+		// Markings are 12 cm on a 3.6 m lane
+		double half = max(0.5, road.lane_width * d * 0.12 / 3.6 / 2);
+		for (int m = 0; m < 2; m++) {
+			// The right marking is dashed; distance along the road goes
+			// as 1/d, so dashes shrink towards the horizon
+			if (m == 1 && s.dash_period > 0) {
+				double phase = 4.0 / d + (double)t / s.dash_period;
+				if (phase - floor(phase) > 0.4)
+					continue;
+			}
+			double x = road.MarkingX(s, lateral[m], curvature, y);
+			int x0 = max((int)floor(x - half), 0);
+			int x1 = min((int)ceil(x + half), s.width - 1);
+			for (int xi = x0; xi <= x1; xi++)
+				row[xi] = paint;
+		}
+	}
+
+	if (s.noise > 0) {
+		rng.fill(noise, RNG::NORMAL, 0, s.noise);
+		Mat wide;
+		gray.convertTo(wide, CV_16S);
+		wide += noise;
+		wide.convertTo(gray, CV_8U);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Scene s;
+	string name;
+
+	try {
+		TCLAP::CmdLine cmd_line("Synthetic road clip generator", ' ', LDWS_VERSION);
+		TCLAP::ValueArg<int> width_int("","width","Frame width", false, 1280, "pixels");
+		cmd_line.add(width_int);
+		TCLAP::ValueArg<int> height_int("","height","Frame height", false, 720, "pixels");
+		cmd_line.add(height_int);
+		TCLAP::ValueArg<int> frames_int("n","frames","Number of frames", false, 300, "count");
+		cmd_line.add(frames_int);
+		TCLAP::ValueArg<double> curvature_double("","curvature","Bend of the road at the horizon, in lane widths", false, 0.3, "lanes");
+		cmd_line.add(curvature_double);
+		TCLAP::ValueArg<double> drift_double("","drift","Amplitude of the lateral vehicle motion, in lane widths", false, 0.2, "lanes");
+		cmd_line.add(drift_double);
+		TCLAP::ValueArg<double> noise_double("","noise","Sensor noise sigma", false, 4, "levels");
+		cmd_line.add(noise_double);
+		TCLAP::ValueArg<double> lighting_double("","lighting","Amplitude of the brightness changes", false, 0.2, "fraction");
+		cmd_line.add(lighting_double);
+		TCLAP::ValueArg<int> dash_int("","dash-period","Frames per dash cycle of the right marking, 0 for solid", false, 20, "frames");
+		cmd_line.add(dash_int);
+		TCLAP::ValueArg<unsigned> seed_int("","seed","Noise seed", false, 1, "seed");
+		cmd_line.add(seed_int);
+		TCLAP::UnlabeledValueArg<string> name_string("name","Output name, without extension", true, "", "name");
+		cmd_line.add(name_string);
+		cmd_line.parse(argc, argv);
+
+		s.width = width_int.getValue() & ~1;
+		s.height = height_int.getValue() & ~1;
+		s.frames = frames_int.getValue();
+		s.curvature = curvature_double.getValue();
+		s.drift = drift_double.getValue();
+		s.noise = noise_double.getValue();
+		s.lighting = lighting_double.getValue();
+		s.dash_period = dash_int.getValue();
+		s.seed = seed_int.getValue();
+		name = name_string.getValue();
+	} catch (TCLAP::ArgException &e) {
+		cerr << "error: " << e.error() << " for arg " << e.argId() << endl;
+		return 1;
+	}
+
+	if (s.width < 64 || s.height < 64 || s.frames <= 0) {
+		cerr << "error: clip too small" << endl;
+		return 1;
+	}
+
+	Road road;
+	road.cx = s.width / 2.0;
+	road.horizon = s.height * 0.45;
+	road.lane_width = s.width * 0.8;
+	Rect roi = scene_roi(s, road);
+
+	string video_name = name + ".y4m";
+	FILE *video = fopen(video_name.c_str(), "wb");
+	ofstream truth((name + ".csv").c_str());
+	ofstream conf((name + ".conf").c_str());
+	if (!video || !truth || !conf) {
+		cerr << "error: cannot write " << name << ".*" << endl;
+		return 1;
+	}
+
+	conf << "# " << s.width << "x" << s.height << " synthetic road, made by ldws-synth" << endl << endl;
+	conf << "video_input_file = \"" << video_name << "\";" << endl << endl;
+	conf << "region_of_interest = {x=" << roi.x << "; y=" << roi.y << "; w=" << roi.width
+		<< "; h=" << roi.height << "};" << endl;
+
+	truth << "frame,left_k,left_b,left_lost,right_k,right_b,right_lost" << endl;
+
+	fprintf(video, "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 C420jpeg\n", s.width, s.height);
+	Mat gray(s.height, s.width, CV_8UC1);
+	Mat noise(s.height, s.width, CV_16SC1);
+	vector<uchar> chroma(s.width * s.height / 2, 128);
+	RNG rng(s.seed);
+
+	for (int t = 0; t < s.frames; t++) {
+		// The vehicle weaves inside its lane and the road bends back
+		// and forth slowly
+		double offset = s.drift * sin(2 * CV_PI * t / 200.0);
+		double lateral[2] = { -0.5 - offset, 0.5 - offset };
+		double curvature = s.curvature * sin(2 * CV_PI * t / 500.0);
+
+		render(s, road, t, lateral, curvature, rng, gray, noise);
+
+		fprintf(video, "FRAME\n");
+		fwrite(gray.data, 1, gray.total(), video);
+		fwrite(&chroma[0], 1, chroma.size(), video);
+
+		float k[2], b[2];
+		for (int m = 0; m < 2; m++)
+			fit_marking(s, road, roi, lateral[m], curvature, k[m], b[m]);
+		truth << t << "," << k[0] << "," << b[0] << ",0," << k[1] << "," << b[1] << ",0" << endl;
+	}
+
+	fclose(video);
+	cout << video_name << ": " << s.frames << " frames, " << s.width << "x" << s.height << endl;
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <atomic>
+#include <fcntl.h>
+#include <iostream>
+#include <opencv2/core/utility.hpp>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lane_detector.h"
+#include "stage_stats.h"
+#include "telemetry.h"
+
+using namespace cv;
+using namespace std;
+
+// Copies retried before a reader gives up on a busy writer
+static const int READ_ATTEMPTS = 100;
+
+void TelemetryWriter::Update(long frame, const LaneDetector& ld)
+{
+	if (!block)
+		return;
+
+	StageStats *stats = StageStats::GetInstance();
+	TelemetryData& d = block->data;
+
+	// Odd sequence: readers started from here on retry
+	uint32_t seq = block->seq.load(memory_order_relaxed);
+	block->seq.store(seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	d.frame = frame;
+	d.update_tick = getTickCount();
+	d.fps = stats->CurrentFps();
+	d.average_fps = stats->AverageFps();
+	for (int i = 0; i < NUM_STAGES; i++) {
+		const LatencyHistogram& h = stats->Get((Stage)i);
+		d.stage_last_ms[i] = h.Last() * 1e3;
+		d.stage_mean_ms[i] = h.Mean() * 1e3;
+	}
+	for (int s = 0; s < 2; s++) {
+		LaneDetector::LaneState state = ld.GetLaneState(s == 1);
+		TelemetryLane& lane = d.lanes[s];
+		lane.k = state.k;
+		lane.b = state.b;
+		lane.lost = state.lost;
+		lane.reset = state.reset;
+		if (state.reset && !was_reset[s])
+			lane.resets++;
+		was_reset[s] = state.reset;
+		lane.candidates = ld.Candidates(s == 1);
+	}
+
+	block->seq.store(seq + 2, memory_order_release);
+}
+
+bool TelemetryWriter::Open(const string& name)
+{
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		cerr << "error: cannot open telemetry shared memory " << name << endl;
+		return false;
+	}
+
+	void *map = MAP_FAILED;
+	if (ftruncate(fd, sizeof(TelemetryBlock)) == 0)
+		map = mmap(NULL, sizeof(TelemetryBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		cerr << "error: cannot map telemetry shared memory " << name << endl;
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	// A block left behind by an earlier run starts over; readers see
+	// the new pid
+	block = (TelemetryBlock*)map;
+	block->seq.store(1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memset(&block->data, 0, sizeof(block->data));
+	block->data.tick_frequency = getTickFrequency();
+	block->magic = TELEMETRY_MAGIC;
+	block->version = TELEMETRY_VERSION;
+	block->pid = getpid();
+	block->num_stages = NUM_STAGES;
+	block->seq.store(2, memory_order_release);
+
+	this->name = name;
+	was_reset[0] = was_reset[1] = true;
+	return true;
+}
+
+TelemetryWriter::TelemetryWriter()
+	: block(NULL)
+{
+	was_reset[0] = was_reset[1] = true;
+}
+
+TelemetryWriter::~TelemetryWriter()
+{
+	if (!block)
+		return;
+	munmap(block, sizeof(TelemetryBlock));
+	shm_unlink(name.c_str());
+}
+
+bool TelemetryReader::Read(TelemetryData& data, int32_t& pid) const
+{
+	if (!block)
+		return false;
+
+	for (int i = 0; i < READ_ATTEMPTS; i++) {
+		uint32_t begin = block->seq.load(memory_order_acquire);
+		if (begin & 1)
+			continue;
+		memcpy(&data, (const void*)&block->data, sizeof(data));
+		pid = block->pid;
+		atomic_thread_fence(memory_order_acquire);
+		if (block->seq.load(memory_order_relaxed) == begin)
+			return true;
+	}
+	return false;
+}
+
+bool TelemetryReader::Open(const string& name)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	// The writer may not have sized the object yet
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TelemetryBlock))
+		map = mmap(NULL, sizeof(TelemetryBlock), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	const TelemetryBlock *b = (const TelemetryBlock*)map;
+	if (b->magic != TELEMETRY_MAGIC || b->version != TELEMETRY_VERSION || b->num_stages != NUM_STAGES) {
+		cerr << "error: " << name << " is not a compatible telemetry block" << endl;
+		munmap(map, sizeof(TelemetryBlock));
+		return false;
+	}
+	if (block)
+		munmap((void*)block, sizeof(TelemetryBlock));
+	block = b;
+	return true;
+}
+
+TelemetryReader::TelemetryReader()
+	: block(NULL)
+{
+}
+
+TelemetryReader::~TelemetryReader()
+{
+	if (block)
+		munmap((void*)block, sizeof(TelemetryBlock));
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include "lane_detector.h"
+#include "stage_stats.h"
+
+// Layout of the shared memory block. Only fixed size fields, so readers
+// built separately agree on it; bump TELEMETRY_VERSION on any change.
+static const uint32_t TELEMETRY_MAGIC = 0x4c445754;    // "LDWT"
+static const uint32_t TELEMETRY_VERSION = 1;
+
+struct TelemetryLane {
+	float k, b;             // ROI coordinates, like LaneState
+	int32_t lost;
+	int32_t reset;
+	uint64_t resets;        // times the side was reset so far
+	int32_t candidates;     // Hough candidates of the last frame
+	int32_t pad;
+};
+
+struct TelemetryData {
+	int64_t frame;
+	int64_t update_tick;    // getTickCount() at the last update
+	double tick_frequency;
+	double fps, average_fps;
+	double stage_last_ms[NUM_STAGES];
+	double stage_mean_ms[NUM_STAGES];
+	TelemetryLane lanes[2]; // left, right
+};
+
+struct TelemetryBlock {
+	uint32_t magic;
+	uint32_t version;
+	int32_t pid;
+	int32_t num_stages;
+	// Odd while the writer is in the middle of an update
+	std::atomic<uint32_t> seq;
+	uint32_t pad;
+	TelemetryData data;
+};
+
+// Publishes the detector state into POSIX shared memory once per frame.
+// The block is guarded by a sequence lock: the single writer never
+// waits, and readers retry when an update overlapped their copy.
+class TelemetryWriter
+{
+	public:
+		TelemetryWriter();
+		~TelemetryWriter();
+		bool Open(const std::string& name);
+		bool IsOpen() const { return block != NULL; }
+
+		void Update(long frame, const LaneDetector& ld);
+
+	private:
+		std::string name;
+		TelemetryBlock *block;
+		// Reset state of the previous update, to count reset events
+		bool was_reset[2];
+};
+
+// Read side for monitoring tools
+class TelemetryReader
+{
+	public:
+		TelemetryReader();
+		~TelemetryReader();
+		bool Open(const std::string& name);
+		// Consistent copy of the latest update; false if the writer
+		// kept updating through every attempt
+		bool Read(TelemetryData& data, int32_t& pid) const;
+
+	private:
+		const TelemetryBlock *block;
+};
+
+#endif // TELEMETRY_H
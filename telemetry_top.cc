@@ -0,0 +1,143 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// ldws-telemetry streams the live state of running detectors from the
+// shared memory blocks named by their telemetry_shm setting. Reading
+// never blocks or slows down the detector.
+
+#include <chrono>
+#include <iostream>
+#include <opencv2/core/utility.hpp>
+#include <stdio.h>
+#include <string>
+#include <tclap/CmdLine.h>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "stage_stats.h"
+#include "telemetry.h"
+
+using namespace cv;
+using namespace std;
+
+static void print_header(bool csv)
+{
+	if (csv) {
+		printf("name,pid,age_ms,frame,fps,average_fps");
+		for (int s = 0; s < 2; s++) {
+			const char *side = s ? "right" : "left";
+			printf(",%s_k,%s_b,%s_lost,%s_reset,%s_resets,%s_candidates", side, side, side, side, side, side);
+		}
+		for (int i = 0; i < NUM_STAGES; i++)
+			printf(",%s_ms", StageStats::StageName((Stage)i));
+		printf("\n");
+	} else {
+		printf("%-12s %7s %8s %9s %7s  %-28s  %-28s %s\n", "name", "pid", "age ms", "frame", "fps",
+				"left k/b lost resets cand", "right k/b lost resets cand", "slowest stage");
+	}
+}
+
+static void print_sample(const string& name, const TelemetryData& d, int pid, bool csv)
+{
+	double age = (getTickCount() - d.update_tick) / d.tick_frequency * 1e3;
+
+	if (csv) {
+		printf("%s,%d,%.1f,%lld,%.2f,%.2f", name.c_str(), pid, age, (long long)d.frame, d.fps, d.average_fps);
+		for (int s = 0; s < 2; s++) {
+			const TelemetryLane& l = d.lanes[s];
+			printf(",%.4f,%.1f,%d,%d,%llu,%d", l.k, l.b, l.lost, l.reset, (unsigned long long)l.resets, l.candidates);
+		}
+		for (int i = 0; i < NUM_STAGES; i++)
+			printf(",%.3f", d.stage_last_ms[i]);
+		printf("\n");
+		return;
+	}
+
+	// The frame interval is not a processing stage
+	int slowest = 0;
+	for (int i = 1; i < NUM_STAGES; i++)
+		if (i != STAGE_FRAME && i != STAGE_ALERT && d.stage_mean_ms[i] > d.stage_mean_ms[slowest])
+			slowest = i;
+
+	char lanes[2][64];
+	for (int s = 0; s < 2; s++) {
+		const TelemetryLane& l = d.lanes[s];
+		if (l.reset)
+			snprintf(lanes[s], sizeof(lanes[s]), "reset %d %llu %d", l.lost,
+					(unsigned long long)l.resets, l.candidates);
+		else
+			snprintf(lanes[s], sizeof(lanes[s]), "%.3f/%.0f %d %llu %d", l.k, l.b, l.lost,
+					(unsigned long long)l.resets, l.candidates);
+	}
+	printf("%-12s %7d %8.1f %9lld %7.1f  %-28s  %-28s %s %.2f ms\n", name.c_str(), pid, age,
+			(long long)d.frame, d.fps, lanes[0], lanes[1],
+			StageStats::StageName((Stage)slowest), d.stage_mean_ms[slowest]);
+}
+
+int main(int argc, char* argv[])
+{
+	vector<string> names;
+	int interval_ms, count;
+	bool csv;
+
+	try {
+		TCLAP::CmdLine cmd_line("Live detector telemetry", ' ', LDWS_VERSION);
+		TCLAP::ValueArg<int> interval_int("i","interval","Time between samples", false, 1000, "ms");
+		cmd_line.add(interval_int);
+		TCLAP::ValueArg<int> count_int("n","count","Number of samples, 0 to run until interrupted", false, 0, "count");
+		cmd_line.add(count_int);
+		TCLAP::SwitchArg csv_switch("","csv","Stream CSV with every field and stage", cmd_line, false);
+		TCLAP::UnlabeledMultiArg<string> names_string("name","Shared memory names of the detectors, as in telemetry_shm", true, "name");
+		cmd_line.add(names_string);
+		cmd_line.parse(argc, argv);
+
+		names = names_string.getValue();
+		interval_ms = interval_int.getValue();
+		count = count_int.getValue();
+		csv = csv_switch.getValue();
+	} catch (TCLAP::ArgException &e) {
+		cerr << "error: " << e.error() << " for arg " << e.argId() << endl;
+		return 1;
+	}
+
+	vector<TelemetryReader*> readers;
+	for (size_t i = 0; i < names.size(); i++) {
+		readers.push_back(new TelemetryReader());
+		if (!readers[i]->Open(names[i]))
+			cerr << "error: cannot open telemetry " << names[i] << endl;
+	}
+
+	print_header(csv);
+	for (int n = 0; count <= 0 || n < count; n++) {
+		if (n > 0)
+			this_thread::sleep_for(chrono::milliseconds(interval_ms));
+
+		// Detectors started after this tool are picked up as they appear
+		for (size_t i = 0; i < readers.size(); i++) {
+			TelemetryData d;
+			int32_t pid;
+			if (!readers[i]->Read(d, pid) && !(readers[i]->Open(names[i]) && readers[i]->Read(d, pid)))
+				continue;
+			print_sample(names[i], d, pid, csv);
+		}
+		fflush(stdout);
+	}
+
+	for (size_t i = 0; i < readers.size(); i++)
+		delete readers[i];
+	return 0;
+}
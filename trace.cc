@@ -0,0 +1,269 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <opencv2/core.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "config_store.h"
+#include "edge_runs.h"
+#include "frame.h"
+#include "lane_detector.h"
+#include "trace.h"
+
+using namespace cv;
+using namespace std;
+
+static size_t record_bytes(int num_lines, int rows, int num_runs)
+{
+	size_t n = sizeof(TraceRecord) + num_lines * 4 * sizeof(int16_t) +
+		rows * sizeof(uint16_t) + num_runs * 2 * sizeof(uint16_t);
+	return (n + 7) & ~(size_t)7;
+}
+
+TraceWriter::TraceWriter()
+{
+	cs = NULL;
+	out = NULL;
+	failed = false;
+	memset(&header, 0, sizeof(header));
+}
+
+TraceWriter::~TraceWriter()
+{
+	if (out)
+		Close();
+}
+
+bool TraceWriter::Open(const ConfigStore *cs, const string& path, int frame_width)
+{
+	// Runs and lines are stored as 16 bit
+	if (cs->roi.w <= 0 || cs->roi.h <= 0 || cs->roi.w > 0x7fff || cs->roi.h > 0x7fff)
+		return false;
+
+	// Written under a temporary name so a partial trace is never read
+	string tmp = path + ".tmp";
+	out = fopen(tmp.c_str(), "wb");
+	if (!out)
+		return false;
+
+	this->cs = cs;
+	this->path = path;
+	failed = false;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.frame_width = frame_width;
+	header.roi_x = cs->roi.x;
+	header.roi_y = cs->roi.y;
+	header.roi_w = cs->roi.w;
+	header.roi_h = cs->roi.h;
+	header.line_reject_degrees = cs->line_reject_degrees;
+	header.scan_step = cs->scan_step;
+	header.bw_thresh = cs->bw_thresh;
+	header.borderx = cs->borderx;
+	header.max_response_dist = cs->max_response_dist;
+	header.b_vary_factor = cs->b_vary_factor;
+	header.max_lost_frames = cs->max_lost_frames;
+	header.keyframe_interval = cs->keyframe_interval;
+	header.k_vary_factor = cs->k_vary_factor;
+	header.tracker_beta = cs->tracker_beta;
+	if (fwrite(&header, sizeof(header), 1, out) != 1)
+		failed = true;
+	return true;
+}
+
+void TraceWriter::Write(const Frame& f, const vector<Vec4i>& lines, int left_lines, int scan_step,
+		const LaneDetector& ld)
+{
+	if (!out || failed)
+		return;
+
+	// Runs made during detection are reused, the edge map is binary
+	// either way
+	const EdgeRuns *r = &f.runs;
+	if (!cs->edge_runs || f.runs.EdgeSize() != f.edge.size()) {
+		runs.Build(f.edge);
+		r = &runs;
+	}
+	if (r->EdgeSize() != Size(header.roi_w, header.roi_h)) {
+		failed = true;
+		return;
+	}
+
+	int num_lines = f.verify_only ? 0 : lines.size();
+	int rows = r->Rows();
+	int num_runs = r->RowEnd(rows - 1) - r->RowBegin(0);
+	record.assign(record_bytes(num_lines, rows, num_runs), 0);
+
+	TraceRecord *rec = (TraceRecord*)&record[0];
+	rec->index = f.index;
+	rec->bytes = record.size();
+	rec->flags = f.verify_only ? TRACE_VERIFY_ONLY : 0;
+	rec->scan_step = scan_step;
+	rec->left_lines = left_lines;
+	rec->num_lines = num_lines;
+	rec->num_runs = num_runs;
+	for (int s = 0; s < 2; s++) {
+		LaneDetector::LaneState state = ld.GetLaneState(s == 1);
+		rec->lanes[s].k = state.k;
+		rec->lanes[s].b = state.b;
+		rec->lanes[s].support = state.support;
+		rec->lanes[s].lost = state.lost;
+		rec->lanes[s].reset = state.reset;
+	}
+
+	int16_t *l = (int16_t*)(rec + 1);
+	for (int i = 0; i < num_lines; i++)
+		for (int j = 0; j < 4; j++)
+			*l++ = lines[i][j];
+
+	uint16_t *counts = (uint16_t*)l;
+	uint16_t *pairs = counts + rows;
+	for (int y = 0; y < rows; y++) {
+		counts[y] = r->RowEnd(y) - r->RowBegin(y);
+		for (const EdgeRuns::Run *run = r->RowBegin(y); run != r->RowEnd(y); run++) {
+			*pairs++ = run->begin;
+			*pairs++ = run->end;
+		}
+	}
+
+	if (fwrite(&record[0], record.size(), 1, out) != 1)
+		failed = true;
+	else
+		header.frames++;
+}
+
+bool TraceWriter::Close()
+{
+	if (!out)
+		return false;
+
+	// The frame count goes in last
+	bool ok = !failed && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+	ok = (fclose(out) == 0) && ok;
+	out = NULL;
+	string tmp = path + ".tmp";
+	if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+TraceReader::TraceReader()
+{
+	data = NULL;
+	length = 0;
+	header = NULL;
+}
+
+TraceReader::~TraceReader()
+{
+	if (data)
+		munmap((void*)data, length);
+}
+
+bool TraceReader::Open(const string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TraceHeader))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	const char *p = (const char*)map;
+	const TraceHeader *h = (const TraceHeader*)p;
+	bool ok = memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) == 0 &&
+		h->roi_w > 0 && h->roi_h > 0 && h->frames >= 0;
+
+	// Index the records, checking that each one adds up
+	vector<size_t> offsets;
+	size_t off = sizeof(TraceHeader);
+	for (int64_t i = 0; ok && i < h->frames; i++) {
+		const TraceRecord *rec = (const TraceRecord*)(p + off);
+		ok = off + sizeof(TraceRecord) <= (size_t)st.st_size && rec->num_lines >= 0 && rec->num_runs >= 0 &&
+			rec->bytes > 0 && (size_t)rec->bytes == record_bytes(rec->num_lines, h->roi_h, rec->num_runs) &&
+			off + rec->bytes <= (size_t)st.st_size;
+		if (!ok)
+			break;
+		const uint16_t *counts = (const uint16_t*)((const int16_t*)(rec + 1) + rec->num_lines * 4);
+		long sum = 0;
+		for (int y = 0; y < h->roi_h; y++)
+			sum += counts[y];
+		ok = sum == rec->num_runs && rec->scan_step > 0;
+		offsets.push_back(off);
+		off += rec->bytes;
+	}
+	if (!ok || off != (size_t)st.st_size) {
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	data = p;
+	length = st.st_size;
+	header = h;
+	records.swap(offsets);
+	return true;
+}
+
+void TraceReader::ApplySettings(ConfigStore *cs) const
+{
+	cs->roi.x = header->roi_x;
+	cs->roi.y = header->roi_y;
+	cs->roi.w = header->roi_w;
+	cs->roi.h = header->roi_h;
+	cs->line_reject_degrees = header->line_reject_degrees;
+	cs->scan_step = header->scan_step;
+	cs->bw_thresh = header->bw_thresh;
+	cs->borderx = header->borderx;
+	cs->max_response_dist = header->max_response_dist;
+	cs->b_vary_factor = header->b_vary_factor;
+	cs->max_lost_frames = header->max_lost_frames;
+	cs->keyframe_interval = header->keyframe_interval;
+	cs->k_vary_factor = header->k_vary_factor;
+	cs->tracker_beta = header->tracker_beta;
+}
+
+void TraceReader::Get(long i, TraceFrame& f) const
+{
+	const TraceRecord *rec = (const TraceRecord*)(data + records[i]);
+	f.index = rec->index;
+	f.verify_only = (rec->flags & TRACE_VERIFY_ONLY) != 0;
+	f.scan_step = rec->scan_step;
+	f.left_lines = rec->left_lines;
+	f.lanes[0] = rec->lanes[0];
+	f.lanes[1] = rec->lanes[1];
+
+	const int16_t *l = (const int16_t*)(rec + 1);
+	f.lines.resize(rec->num_lines);
+	for (int j = 0; j < rec->num_lines; j++, l += 4)
+		f.lines[j] = Vec4i(l[0], l[1], l[2], l[3]);
+
+	const uint16_t *counts = (const uint16_t*)l;
+	f.runs.Load(RoiSize(), counts, counts + header->roi_h);
+}
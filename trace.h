@@ -0,0 +1,144 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <opencv2/core.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "config_store.h"
+#include "edge_runs.h"
+#include "frame.h"
+#include "lane_detector.h"
+
+using namespace cv;
+using namespace std;
+
+// Layout of a trace file: a TraceHeader, then per frame a TraceRecord
+// followed by num_lines lines as four int16 (x0, y0, x1, y1), the run
+// count of every ROI row as uint16 and num_runs (begin, end) runs as
+// uint16. Records are padded to 8 bytes. Everything is in host byte
+// order; bump the last magic byte on any change.
+static const char TRACE_MAGIC[8] = { 'L', 'D', 'W', 'S', 'T', 'R', 'C', '1' };
+
+struct TraceHeader {
+	char magic[8];
+	int32_t frame_width;
+	int32_t roi_x, roi_y, roi_w, roi_h;
+	// The settings LaneDetector was run with
+	int32_t line_reject_degrees;
+	int32_t scan_step;
+	int32_t bw_thresh;
+	int32_t borderx;
+	int32_t max_response_dist;
+	int32_t b_vary_factor;
+	int32_t max_lost_frames;
+	int32_t keyframe_interval;
+	float k_vary_factor;
+	float tracker_beta;
+	int32_t reserved;
+	int64_t frames;
+};
+
+struct TraceLane {
+	float k, b, support;    // LaneState after the frame
+	int32_t lost;
+	int32_t reset;
+};
+
+enum {
+	TRACE_VERIFY_ONLY = 1,  // TrackLanes instead of ProcessLanes
+};
+
+struct TraceRecord {
+	int64_t index;
+	int32_t bytes;          // whole record including padding
+	int32_t flags;
+	int32_t scan_step;
+	int32_t left_lines;
+	int32_t num_lines;
+	int32_t num_runs;
+	TraceLane lanes[2];     // left, right
+};
+
+// One frame of a trace, decoded
+struct TraceFrame {
+	long index;
+	bool verify_only;
+	int scan_step;
+	int left_lines;
+	vector<Vec4i> lines;
+	EdgeRuns runs;
+	TraceLane lanes[2];
+};
+
+// Records, in frame order, everything LaneDetector consumed for each
+// frame and the lane state it ended up in, so lane tracking can be
+// replayed without decoding video or finding edges and lines.
+class TraceWriter
+{
+	public:
+		TraceWriter();
+		~TraceWriter();
+		bool Open(const ConfigStore *cs, const string& path, int frame_width);
+		bool IsOpened() const { return out != NULL; }
+
+		// Call after ld processed f with lines and left_lines, which
+		// may be those of an earlier frame
+		void Write(const Frame& f, const vector<Vec4i>& lines, int left_lines, int scan_step,
+				const LaneDetector& ld);
+		// Completes the file, false if anything failed to be written
+		bool Close();
+		long Frames() const { return header.frames; }
+
+	private:
+		const ConfigStore *cs;
+		FILE *out;
+		string path;
+		TraceHeader header;
+		bool failed;
+		EdgeRuns runs;
+		vector<char> record;
+};
+
+// Memory maps a trace read-only
+class TraceReader
+{
+	public:
+		TraceReader();
+		~TraceReader();
+		bool Open(const string& path);
+
+		long Frames() const { return records.size(); }
+		int FrameWidth() const { return header->frame_width; }
+		Size RoiSize() const { return Size(header->roi_w, header->roi_h); }
+		// Sets what the trace records of cs
+		void ApplySettings(ConfigStore *cs) const;
+		void Get(long i, TraceFrame& f) const;
+
+	private:
+		const char *data;
+		size_t length;
+		const TraceHeader *header;
+		vector<size_t> records; // offsets of the records
+};
+
+#endif // TRACE_H
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+// ldws-replay runs lane tracking on a trace recorded with --record-trace
+// and checks that every frame ends in the recorded lane state, bit for
+// bit. Video decode, edge and line detection are not repeated, so
+// changes to the lane post-processing are validated in seconds.
+
+#include <algorithm>
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <tclap/CmdLine.h>
+
+#include "config.h"
+#include "config_store.h"
+#include "lane_detector.h"
+#include "response_scan.h"
+#include "trace.h"
+
+using namespace cv;
+using namespace std;
+
+static bool same_lane(const TraceLane& a, const LaneDetector::LaneState& b)
+{
+	// Compared as bits, so a NaN matches itself
+	return memcmp(&a.k, &b.k, sizeof(float)) == 0 && memcmp(&a.b, &b.b, sizeof(float)) == 0 &&
+		memcmp(&a.support, &b.support, sizeof(float)) == 0 &&
+		a.lost == b.lost && (a.reset != 0) == b.reset;
+}
+
+static void print_mismatch(const TraceFrame& tf, int side, const LaneDetector::LaneState& s)
+{
+	const TraceLane& l = tf.lanes[side];
+	printf("frame %ld %s: recorded k %.9g b %.9g support %.9g lost %d reset %d, "
+			"replayed k %.9g b %.9g support %.9g lost %d reset %d\n",
+			tf.index, side ? "right" : "left", l.k, l.b, l.support, l.lost, l.reset,
+			s.k, s.b, s.support, s.lost, (int)s.reset);
+}
+
+int main(int argc, char* argv[])
+{
+	string path;
+	int repeat;
+	int max_reports;
+	bool side_parallel;
+
+	try {
+		TCLAP::CmdLine cmd_line("Lane tracking trace replay", ' ', LDWS_VERSION);
+		TCLAP::ValueArg<int> repeat_int("r","repeat","Number of times the trace is replayed, for timing", false, 1, "count");
+		cmd_line.add(repeat_int);
+		TCLAP::ValueArg<int> max_reports_int("m","max-reports","Number of mismatching frames printed", false, 10, "count");
+		cmd_line.add(max_reports_int);
+		TCLAP::SwitchArg side_parallel_switch("","side-parallel","Process the two sides on two threads", cmd_line, false);
+		TCLAP::UnlabeledValueArg<string> trace_string("trace","Trace file written with --record-trace", true, "", "filename");
+		cmd_line.add(trace_string);
+		cmd_line.parse(argc, argv);
+
+		path = trace_string.getValue();
+		repeat = max(repeat_int.getValue(), 1);
+		max_reports = max_reports_int.getValue();
+		side_parallel = side_parallel_switch.getValue();
+	} catch (TCLAP::ArgException &e) {
+		cerr << "error: " << e.error() << " for arg " << e.argId() << endl;
+		return 1;
+	}
+
+	TraceReader reader;
+	if (!reader.Open(path)) {
+		cerr << "error: " << path << " is not a complete trace" << endl;
+		return 1;
+	}
+
+	// Only what the trace recorded matters to LaneDetector
+	ConfigStore cs;
+	reader.ApplySettings(&cs);
+	cs.side_parallel = side_parallel;
+
+	TraceFrame tf;
+	ResponseScanner scan;
+	const Mat no_edge;
+	long lines = 0;
+	long mismatches = 0;
+	double seconds = 0;
+
+	for (int r = 0; r < repeat; r++) {
+		// A fresh detector every pass, tracking starts from scratch
+		LaneDetector ld(&cs);
+		int64 start = getTickCount();
+		for (long i = 0; i < reader.Frames(); i++) {
+			reader.Get(i, tf);
+			scan.Scan(tf.runs, cs.bw_thresh, cs.borderx, tf.scan_step);
+			ld.SetScanStep(tf.scan_step);
+			if (tf.verify_only)
+				ld.TrackLanes(no_edge, &scan);
+			else
+				ld.ProcessLanes(tf.lines, no_edge, reader.FrameWidth(), tf.left_lines, &scan);
+			lines += tf.lines.size();
+
+			// Checked on the first pass only, the others are for timing
+			if (r > 0)
+				continue;
+			bool same = true;
+			for (int s = 0; s < 2; s++) {
+				LaneDetector::LaneState state = ld.GetLaneState(s == 1);
+				if (same_lane(tf.lanes[s], state))
+					continue;
+				if (mismatches < max_reports)
+					print_mismatch(tf, s, state);
+				same = false;
+			}
+			mismatches += !same;
+		}
+		seconds += (getTickCount() - start) / getTickFrequency();
+	}
+
+	long frames = reader.Frames() * repeat;
+	cout << "Replayed " << reader.Frames() << " frames";
+	if (repeat > 1)
+		cout << " " << repeat << " times";
+	cout << " in " << seconds << " s: " << (seconds > 0 ? frames / seconds : 0) << " frames/s, "
+		<< (seconds > 0 ? lines / seconds : 0) << " lines/s" << endl;
+
+	if (mismatches) {
+		cout << mismatches << " of " << reader.Frames() << " frames differ from the recording" << endl;
+		return 1;
+	}
+	cout << "All frames match the recording" << endl;
+	return 0;
+}
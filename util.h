@@ -43,9 +43,59 @@ class ExpMovingAverage {
 			oldValue = newValue;
 		}
 
-		double get() {
+		double get() const {
 			return oldValue;
 		}
 };
 
+// Alpha-beta filter, a steady state Kalman filter for a value and its
+// rate of change per frame. Call predict() once per frame and add()
+// for every measurement. With beta = 0 it is the same as
+// ExpMovingAverage with the same alpha.
+class AlphaBetaFilter {
+	private:
+		double alpha;
+		double beta;
+		double value;
+		double rate;
+		bool unset;
+	public:
+		AlphaBetaFilter(double alpha = 0.2, double beta = 0) {
+			this->alpha = alpha;
+			this->beta = beta;
+			value = 0;
+			rate = 0;
+			unset = true;
+		}
+
+		void set_gains(double alpha, double beta) {
+			this->alpha = alpha;
+			this->beta = beta;
+		}
+
+		void clear() {
+			unset = true;
+			rate = 0;
+		}
+
+		void predict() {
+			if (!unset)
+				value += rate;
+		}
+
+		void add(double measured) {
+			if (unset) {
+				value = measured;
+				unset = false;
+			}
+			double residual = measured - value;
+			value += alpha * residual;
+			rate += beta * residual;
+		}
+
+		double get() const {
+			return value;
+		}
+};
+
 #endif // UTIL_H
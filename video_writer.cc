@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <thread>
+
+#include "config_store.h"
+#include "stage_stats.h"
+#include "video_writer.h"
+
+using namespace cv;
+using namespace std;
+
+// Idle poll interval of the encoder thread, small next to a frame period
+static const int ENCODER_POLL_US = 500;
+
+void AsyncVideoWriter::Encode(int i)
+{
+	{
+		StageTimer t(STAGE_ENCODE);
+		writer << buffers[i];
+	}
+	written.fetch_add(1, memory_order_relaxed);
+	free_buffers.Push(i);
+}
+
+void AsyncVideoWriter::Loop()
+{
+	int i;
+	while (true) {
+		if (pending.TryPop(i)) {
+			Encode(i);
+			continue;
+		}
+		if (stop.load(memory_order_acquire))
+			break;
+		this_thread::sleep_for(chrono::microseconds(ENCODER_POLL_US));
+	}
+
+	// Frames queued after the last empty pop but before Stop() are
+	// visible now that stop is, encode them before leaving
+	while (pending.TryPop(i))
+		Encode(i);
+}
+
+bool AsyncVideoWriter::Write(const Mat& frame)
+{
+	int i;
+	if (drop) {
+		if (!free_buffers.TryPop(i)) {
+			dropped.fetch_add(1, memory_order_relaxed);
+			return false;
+		}
+	} else {
+		i = free_buffers.Pop();
+	}
+
+	// Buffers keep their allocation from the first frames on
+	frame.copyTo(buffers[i]);
+	pending.Push(i);
+
+	size_t depth = pending.Size();
+	writes++;
+	depth_sum += depth;
+	max_depth = max(max_depth, depth);
+	return true;
+}
+
+bool AsyncVideoWriter::Start(Size frame_size)
+{
+	const string& codec = cs->video_codec;
+	if (codec.size() != 4) {
+		cerr << "error: video_codec must be a four character code, not " << codec << endl;
+		return false;
+	}
+
+	writer.open(cs->video_out, VideoWriter::fourcc(codec[0], codec[1], codec[2], codec[3]),
+			cs->video_fps, frame_size, true);
+	if (!writer.isOpened()) {
+		cerr << "error: cannot write " << cs->video_out << " with codec " << codec << endl;
+		return false;
+	}
+
+	stop.store(false);
+	worker = thread(&AsyncVideoWriter::Loop, this);
+	return true;
+}
+
+void AsyncVideoWriter::Stop()
+{
+	if (!worker.joinable())
+		return;
+
+	stop.store(true, memory_order_release);
+	worker.join();
+	writer.release();
+}
+
+AsyncVideoWriter::AsyncVideoWriter(const ConfigStore *cs)
+	: pending(max(cs->encoder_queue, 1)), free_buffers(max(cs->encoder_queue, 1))
+{
+	this->cs = cs;
+	drop = cs->encoder_overflow == "drop";
+	buffers.resize(max(cs->encoder_queue, 1));
+	for (int i = 0; i < (int)buffers.size(); i++)
+		free_buffers.Push(i);
+	stop.store(false);
+	written.store(0);
+	dropped.store(0);
+	writes = 0;
+	depth_sum = 0;
+	max_depth = 0;
+}
+
+AsyncVideoWriter::~AsyncVideoWriter()
+{
+	Stop();
+}
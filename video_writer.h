@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016 Konsulko Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#ifndef VIDEO_WRITER_H
+#define VIDEO_WRITER_H
+
+#include <atomic>
+#include <opencv2/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "config_store.h"
+#include "spsc_queue.h"
+
+using namespace cv;
+using namespace std;
+
+// Encodes the rendered frames on a thread of its own. Write() copies the
+// frame into one of encoder_queue recycled buffers and hands it over, so
+// the frame loop only pays for the copy. When every buffer is waiting to
+// be encoded, Write() blocks or drops the frame as encoder_overflow says.
+class AsyncVideoWriter
+{
+	public:
+		AsyncVideoWriter(const ConfigStore *cs);
+		~AsyncVideoWriter();
+		// Opens video_out with video_codec and video_fps
+		bool Start(Size frame_size);
+		// Encodes everything queued, then closes the file
+		void Stop();
+
+		bool Write(const Mat& frame);
+
+		uint64_t Written() const { return written.load(std::memory_order_relaxed); }
+		uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+		// Frames waiting for the encoder, sampled at every Write()
+		double MeanDepth() const { return writes ? (double)depth_sum / writes : 0; }
+		size_t MaxDepth() const { return max_depth; }
+
+	private:
+		void Loop();
+		void Encode(int i);
+
+		const ConfigStore *cs;
+		VideoWriter writer;
+		vector<Mat> buffers;
+		// Buffer indices, free ones go back to the frame loop
+		SpscQueue<int> pending, free_buffers;
+		bool drop;
+		std::thread worker;
+		std::atomic<bool> stop;
+		std::atomic<uint64_t> written, dropped;
+		// Only touched by the frame loop
+		uint64_t writes, depth_sum;
+		size_t max_depth;
+};
+
+#endif // VIDEO_WRITER_H